@@ -0,0 +1,711 @@
+// EGA microbenchmarks
+// times the ega.cpp primitives across texture sizes and clip cases, decode/encode, texture serialization
+// and SCF read/write
+// (from memory and from a mapped file)
+//
+// usage: egabench [-quick] [-time ms] [-filter substring] [-json out.json]
+//
+// every result has ns/op, and where it makes sense ns/pixel and MB/s
+// - pixels are the pixels the call actually lands on the target (clipped away pixels don't count)
+//   so fully clipped cases only report ns/op
+// - bytes are what the call produces: 1 per index for draws, 4 per pixel for decode,
+//   the source rgba for encode and the buffer size for SCF and texture serialization
+
+#define _USE_MATH_DEFINES
+
+#include "ega.h"
+#include "scf.h"
+#include "file.h"
+#include "texture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#pragma region HARNESS
+
+struct BenchConfig {
+   bool quick = false;
+   f64 batchNs = 20e6;     // each batch runs at least this long
+   u32 batches = 5;        // best batch wins
+   std::string filter;
+   std::string jsonPath;
+};
+
+struct BenchResult {
+   std::string name;
+   std::string storage;    // linear, tiled or empty when it doesn't apply
+   std::string clip;
+   Int2 size = { 0 };
+   u64 iterations = 0;
+   f64 nsPerOp = 0;
+   f64 pixels = 0;         // per op
+   f64 bytes = 0;          // per op
+};
+
+struct Bench {
+   BenchConfig config;
+   std::vector<BenchResult> results;
+};
+
+static f64 _nowNs() {
+   using namespace std::chrono;
+   return (f64)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string _resultName(BenchResult const& r) {
+   auto out = r.name;
+   if (!r.storage.empty()) { out += "/" + r.storage; }
+   if (r.size.x) { out += format("/%dx%d", r.size.x, r.size.y); }
+   if (!r.clip.empty()) { out += "/" + r.clip; }
+   return out;
+}
+
+// fn gets called over and over, grow the batch until it's long enough to time and keep the best one
+template<typename Fn>
+static void _run(Bench &b, BenchResult r, Fn &&fn) {
+   auto fullName = _resultName(r);
+   if (!b.config.filter.empty() && fullName.find(b.config.filter) == std::string::npos) {
+      return;
+   }
+
+   fn(); // warm up, first touch of any buffers
+
+   u64 iterations = 1;
+   f64 best = 0;
+   for (u32 batch = 0; batch < b.config.batches; ++batch) {
+      while (true) {
+         auto start = _nowNs();
+         for (u64 i = 0; i < iterations; ++i) {
+            fn();
+         }
+         auto elapsed = _nowNs() - start;
+
+         if (elapsed < b.config.batchNs && iterations < (1ull << 40)) {
+            // first batch is still calibrating
+            if (!batch) {
+               iterations = elapsed > 0 ? (u64)(iterations * MIN(b.config.batchNs / elapsed * 1.2, 100.0)) + 1 : iterations * 100;
+               continue;
+            }
+         }
+
+         auto perOp = elapsed / iterations;
+         if (!best || perOp < best) {
+            best = perOp;
+         }
+         break;
+      }
+   }
+
+   r.iterations = iterations;
+   r.nsPerOp = best;
+
+   char nsPerPixel[32] = "-", mbPerSec[32] = "-";
+   if (r.pixels > 0) {
+      snprintf(nsPerPixel, sizeof(nsPerPixel), "%.3f", r.nsPerOp / r.pixels);
+   }
+   if (r.bytes > 0) {
+      snprintf(mbPerSec, sizeof(mbPerSec), "%.1f", r.bytes / r.nsPerOp * 1e3);
+   }
+   printf("%-52s %14.1f ns/op %10s ns/px %10s MB/s\n", fullName.c_str(), r.nsPerOp, nsPerPixel, mbPerSec);
+   fflush(stdout);
+
+   b.results.push_back(r);
+}
+
+static void _jsonString(FILE *f, std::string const& s) {
+   fputc('"', f);
+   for (auto c : s) {
+      if (c == '"' || c == '\\') { fputc('\\', f); }
+      fputc(c, f);
+   }
+   fputc('"', f);
+}
+
+static bool _writeJSON(Bench const& b) {
+   auto f = fopen(b.config.jsonPath.c_str(), "w");
+   if (!f) {
+      return false;
+   }
+
+   fprintf(f, "{\n  \"quick\": %s,\n  \"results\": [\n", b.config.quick ? "true" : "false");
+   for (u64 i = 0; i < b.results.size(); ++i) {
+      auto &r = b.results[i];
+      fprintf(f, "    {\"id\": "); _jsonString(f, _resultName(r));
+      fprintf(f, ", \"name\": "); _jsonString(f, r.name);
+      fprintf(f, ", \"storage\": "); _jsonString(f, r.storage);
+      fprintf(f, ", \"clip\": "); _jsonString(f, r.clip);
+      fprintf(f, ", \"width\": %d, \"height\": %d, \"iterations\": %llu, \"ns_per_op\": %.3f",
+         r.size.x, r.size.y, (unsigned long long)r.iterations, r.nsPerOp);
+
+      // null rather than inf when there's nothing to divide by
+      if (r.pixels > 0) { fprintf(f, ", \"pixels\": %.0f, \"ns_per_pixel\": %.6f", r.pixels, r.nsPerOp / r.pixels); }
+      else { fprintf(f, ", \"pixels\": 0, \"ns_per_pixel\": null"); }
+      if (r.bytes > 0) { fprintf(f, ", \"bytes\": %.0f, \"mb_per_sec\": %.3f", r.bytes, r.bytes / r.nsPerOp * 1e3); }
+      else { fprintf(f, ", \"bytes\": 0, \"mb_per_sec\": null"); }
+
+      fprintf(f, "}%s\n", i + 1 < b.results.size() ? "," : "");
+   }
+   fprintf(f, "  ]\n}\n");
+
+   return fclose(f) == 0;
+}
+
+#pragma endregion
+
+#pragma region CASES
+
+static const char *_storageName(bool tiled) {
+   return tiled ? "tiled" : "linear";
+}
+
+static EGATexture *_createTarget(Int2 size, bool tiled) {
+   return tiled ? egaTextureCreateTiled(size.x, size.y) : egaTextureCreate(size.x, size.y);
+}
+
+// all 16 colors plus some alpha so nothing downstream gets to take a solid-color shortcut
+static void _fillPattern(EGATexture *tex, bool withAlpha) {
+   auto size = egaTextureGetSize(tex);
+   egaClear(tex, 0);
+   for (i32 y = 0; y < size.y; y += 4) {
+      egaRenderLine(tex, { 0, y }, { size.x - 1, y }, (EGAPColor)((y / 4) & 15));
+   }
+   for (i32 x = 0; x < size.x; x += 7) {
+      egaRenderLine(tex, { x, 0 }, { x, size.y - 1 }, (EGAPColor)((x / 7 + 3) & 15));
+   }
+   if (withAlpha) {
+      for (i32 x = 3; x < size.x; x += 11) {
+         egaRenderLine(tex, { x, 0 }, { x, size.y - 1 }, EGA_ALPHA);
+      }
+   }
+}
+
+struct ClipCase {
+   const char *name;
+   Recti shape;            // in draw coords, so region-relative when useRegion is set
+   bool useRegion;
+   EGARegion region;       // the full target when useRegion isn't set
+};
+
+static f64 _overlap(Recti a, Recti b) {
+   i32 l = MAX(a.x, b.x), t = MAX(a.y, b.y);
+   i32 r = MIN(a.x + a.w, b.x + b.w), btm = MIN(a.y + a.h, b.y + b.h);
+   if (r <= l || btm <= t || !a.w || !a.h) {
+      return 0.0;
+   }
+   return ((f64)(r - l) * (btm - t)) / ((f64)a.w * a.h);
+}
+
+// inside: half-size shape in the middle
+// partial: same shape hanging off the top-left corner
+// outside: entirely off the right edge, all clip rejection
+// region: drawn through a viewport that clips it on two sides
+static std::vector<ClipCase> _clipCases(Int2 size) {
+   i32 w = size.x / 2, h = size.y / 2;
+   Recti full = { 0, 0, size.x, size.y };
+   Recti region = { size.x / 4, size.y / 4, w, h };
+
+   std::vector<ClipCase> out;
+   out.push_back({ "inside", { size.x / 4, size.y / 4, w, h }, false, full });
+   out.push_back({ "partial", { -w / 2, -h / 2, w, h }, false, full });
+   out.push_back({ "outside", { size.x + 16, size.y / 4, w, h }, false, full });
+   out.push_back({ "region", { -w / 4, -h / 4, w, h }, true, region });
+   return out;
+}
+
+static void _benchPrimitives(Bench &b, Int2 size, bool tiled) {
+   auto target = _createTarget(size, tiled);
+   _fillPattern(target, false);
+
+   auto storage = _storageName(tiled);
+   auto px = (f64)size.x * size.y;
+
+   EGARegion half = { size.x / 4, size.y / 4, size.x / 2, size.y / 2 };
+   f64 halfPx = (f64)half.w * half.h;
+
+   // whole-texture ops, clipped only by a region
+   {
+      u32 frame = 0;
+      _run(b, { "clear", storage, "full", size, 0, 0, px, px }, [&] { egaClear(target, (EGAPColor)(++frame & 15)); });
+      _run(b, { "clear", storage, "region", size, 0, 0, halfPx, halfPx }, [&] { egaClear(target, (EGAPColor)(++frame & 15), &half); });
+      _fillPattern(target, false);
+
+      EGAPColor swap[2][EGA_PALETTE_COLORS];
+      for (u32 i = 0; i < EGA_PALETTE_COLORS; ++i) {
+         swap[0][i] = (EGAPColor)(15 - i);
+         swap[1][i] = (EGAPColor)(15 - i);
+      }
+      // two luts that undo each other so every pass really changes pixels
+      _run(b, { "remap", storage, "full", size, 0, 0, px, px }, [&] { egaRemapIndices(target, swap[++frame & 1]); });
+      _run(b, { "remap", storage, "region", size, 0, 0, halfPx, halfPx }, [&] { egaRemapIndices(target, swap[++frame & 1], &half); });
+      _run(b, { "colorReplace", storage, "full", size, 0, 0, px, px }, [&] {
+         ++frame;
+         egaColorReplace(target, (EGAPColor)(frame & 1), (EGAPColor)((frame + 1) & 1));
+      });
+
+      _run(b, { "clearAlpha", storage, "full", size, 0, 0, px, px }, [&] { egaClearAlpha(target); });
+      _fillPattern(target, false);
+
+      u32 probes = 4096;
+      _run(b, { "getColorAt", storage, "full", size, 0, 0, (f64)probes, 0 }, [&] {
+         u32 acc = 0;
+         for (u32 i = 0; i < probes; ++i) {
+            acc += egaTextureGetColorAt(target, (i * 7919u) % size.x, (i * 104729u) % size.y);
+         }
+         frame += acc & 1;
+      });
+   }
+
+   // font and source textures for the blits
+   auto fontTex = egaTextureCreate(EGA_FONT_GLYPH_WIDTH * 32, EGA_FONT_GLYPH_HEIGHT * 8);
+   _fillPattern(fontTex, false);
+   auto fontFactory = egaFontFactoryCreate(fontTex);
+   auto font = egaFontFactoryGetFont(fontFactory, 0, 15);
+
+   for (auto &c : _clipCases(size)) {
+      auto r = c.shape;
+      auto vp = c.useRegion ? &c.region : nullptr;
+      Int2 pos = { r.x, r.y };
+      Int2 center = { r.x + r.w / 2, r.y + r.h / 2 };
+      i32 radius = MIN(r.w, r.h) / 2;
+      u32 frame = 0;
+
+      // drawn is the call's bounds in draw coords, pixels scale by however much of it survives clipping
+      auto runIn = [&](const char *name, Recti drawn, f64 pixels, auto &&fn) {
+         rectiOffset(&drawn, c.region.x, c.region.y);
+         auto visiblePixels = pixels * _overlap(drawn, c.region);
+         _run(b, { name, storage, c.name, size, 0, 0, visiblePixels, visiblePixels }, fn);
+      };
+      auto run = [&](const char *name, f64 pixels, auto &&fn) {
+         runIn(name, r, pixels, fn);
+      };
+
+      runIn("renderPoint", { center.x, center.y, 1, 1 }, 1, [&] { egaRenderPoint(target, center, (EGAPColor)(++frame & 15), vp); });
+
+      std::vector<Int2> points(4096);
+      for (u32 i = 0; i < points.size(); ++i) {
+         points[i] = { r.x + (i32)((i * 7919u) % MAX(r.w, 1)), r.y + (i32)((i * 104729u) % MAX(r.h, 1)) };
+      }
+      run("renderPoints", (f64)points.size(), [&] { egaRenderPoints(target, points.data(), (u32)points.size(), (EGAPColor)(++frame & 15), vp); });
+
+      run("renderLine", MAX(r.w, r.h), [&] { egaRenderLine(target, pos, { r.x + r.w - 1, r.y + r.h - 1 }, (EGAPColor)(++frame & 15), vp); });
+      runIn("renderLineHorizontal", { center.x, center.y, r.x + r.w - center.x, 1 }, r.x + r.w - center.x, [&] { egaRenderLine(target, center, { r.x + r.w - 1, center.y }, (EGAPColor)(++frame & 15), vp); });
+
+      // a fan of segments and a zigzag polyline over the shape
+      std::vector<Int2> segments, zigzag;
+      f64 segmentPixels = 0, zigzagPixels = 0;
+      for (i32 i = 0; i < 64; ++i) {
+         Int2 a = { r.x, r.y + r.h * i / 64 }, e = { r.x + r.w - 1, r.y + r.h - 1 - r.h * i / 64 };
+         segments.push_back(a);
+         segments.push_back(e);
+         segmentPixels += MAX(abs(e.x - a.x), abs(e.y - a.y)) + 1;
+
+         zigzag.push_back({ r.x + r.w * i / 64, (i & 1) ? r.y : r.y + r.h - 1 });
+         if (i) {
+            zigzagPixels += MAX(abs(zigzag[i].x - zigzag[i - 1].x), abs(zigzag[i].y - zigzag[i - 1].y));
+         }
+      }
+      run("renderLines", segmentPixels, [&] { egaRenderLines(target, segments.data(), 64, (EGAPColor)(++frame & 15), vp); });
+      run("renderPolyline", zigzagPixels, [&] { egaRenderPolyline(target, zigzag.data(), (u32)zigzag.size(), (EGAPColor)(++frame & 15), vp); });
+
+      run("renderRect", (f64)r.w * r.h, [&] { egaRenderRect(target, r, (EGAPColor)(++frame & 15), vp); });
+      run("renderLineRect", 2.0 * (r.w + r.h), [&] { egaRenderLineRect(target, r, (EGAPColor)(++frame & 15), vp); });
+
+      run("renderCircle", 2.0 * M_PI * radius, [&] { egaRenderCircle(target, center, radius, (EGAPColor)(++frame & 15), vp); });
+      run("renderCircleFilled", M_PI * radius * radius, [&] { egaRenderCircleFilled(target, center, radius, (EGAPColor)(++frame & 15), vp); });
+      run("renderEllipse", M_PI * (r.w + r.h) / 2, [&] { egaRenderEllipse(target, r, (EGAPColor)(++frame & 15), vp); });
+      run("renderEllipseFilled", M_PI * r.w * r.h / 4, [&] { egaRenderEllipseFilled(target, r, (EGAPColor)(++frame & 15), vp); });
+      run("renderEllipseQB", 2.0 * M_PI * radius, [&] { egaRenderEllipseQB(target, center, radius, EGA_QB_ASPECT, (EGAPColor)(++frame & 15), vp); });
+      run("renderEllipseQBFilled", M_PI * radius * radius * EGA_QB_ASPECT, [&] { egaRenderEllipseQBFilled(target, center, radius, EGA_QB_ASPECT, (EGAPColor)(++frame & 15), vp); });
+
+      // blits, the source has transparent columns so the masked path gets used
+      auto src = egaTextureCreate(MAX(r.w, 1), MAX(r.h, 1));
+      _fillPattern(src, true);
+      run("renderTexture", (f64)r.w * r.h, [&] { egaRenderTexture(target, pos, src, vp); });
+      runIn("renderTexturePartial", { pos.x, pos.y, r.w / 2, r.h / 2 }, (f64)(r.w / 2) * (r.h / 2), [&] { egaRenderTexturePartial(target, pos, src, { r.w / 4, r.h / 4, r.w / 2, r.h / 2 }, vp); });
+
+      auto packed = egaPackedTextureCreateFromTexture(src);
+      run("renderPackedTexture", (f64)r.w * r.h, [&] { egaRenderPackedTexture(target, pos, packed, vp); });
+      egaPackedTextureDestroy(packed);
+      egaTextureDestroy(src);
+
+      // text doesn't take a region, it only ever clips against the target
+      if (!c.useRegion) {
+         std::string line(MAX(r.w / EGA_FONT_GLYPH_WIDTH, 1), 'A');
+         for (u64 i = 0; i < line.size(); ++i) {
+            line[i] = (char)('!' + i % 90);
+         }
+         runIn("renderText", { pos.x, pos.y, (i32)line.size() * EGA_FONT_GLYPH_WIDTH, EGA_FONT_GLYPH_HEIGHT },
+            (f64)line.size() * EGA_FONT_GLYPH_WIDTH * EGA_FONT_GLYPH_HEIGHT, [&] { egaRenderText(target, line.c_str(), pos, font); });
+      }
+
+      // the border keeps the fill inside the shape, colors alternate so it refills every time
+      egaRenderRect(target, r, 0, vp);
+      egaRenderLineRect(target, r, 15, vp);
+      run("floodFill", (f64)MAX(r.w - 2, 0) * MAX(r.h - 2, 0), [&] { egaFloodFill(target, center, (EGAPColor)(1 + (++frame & 1)), false, vp); });
+      _fillPattern(target, false);
+   }
+
+   egaFontFactoryDestroy(fontFactory);
+   egaTextureDestroy(fontTex);
+
+   // command lists, the same mix recorded once and replayed
+   {
+      auto list = egaCommandListCreate();
+      f64 listPixels = 0;
+      for (i32 i = 0; i < 64; ++i) {
+         Recti r = { (size.x * i / 64) % size.x, (size.y * ((i * 5) % 64) / 64), size.x / 4, size.y / 4 };
+         egaCmdRenderRect(list, r, (EGAPColor)(i & 15));
+         egaCmdRenderLine(list, { 0, r.y }, { size.x - 1, r.y + r.h }, (EGAPColor)((i + 1) & 15));
+         listPixels += (f64)r.w * r.h + size.x;
+      }
+
+      _run(b, { "commandListExecute", storage, "1thread", size, 0, 0, listPixels, listPixels }, [&] { egaCommandListExecute(list, target, 1); });
+      _run(b, { "commandListExecute", storage, "threaded", size, 0, 0, listPixels, listPixels }, [&] { egaCommandListExecute(list, target, 0); });
+      egaCommandListDestroy(list);
+   }
+
+   // history, a small edit then a commit, which only repacks the touched tile
+   {
+      auto history = egaHistoryCreate();
+      egaHistoryCommit(history, target);
+      u32 frame = 0;
+      _run(b, { "historyCommit", storage, "64x64edit", size, 0, 0, 64 * 64, 0 }, [&] {
+         egaRenderRect(target, { 0, 0, MIN(64, size.x), MIN(64, size.y) }, (EGAPColor)(++frame & 15));
+         egaHistoryCommit(history, target);
+      });
+      egaHistoryDestroy(history);
+   }
+
+   _run(b, { "packedCreate", storage, "full", size, 0, 0, px, px / 2 }, [&] {
+      egaPackedTextureDestroy(egaPackedTextureCreateFromTexture(target));
+   });
+
+   egaTextureDestroy(target);
+}
+
+static void _benchDecode(Bench &b, Int2 size, bool tiled) {
+   auto tex = _createTarget(size, tiled);
+   _fillPattern(tex, true);
+   auto storage = _storageName(tiled);
+   auto px = (f64)size.x * size.y;
+
+   // two palettes that share no colors, flipping between them re-decodes every pixel
+   EGAPalette palettes[2];
+   for (u32 i = 0; i < EGA_PALETTE_COLORS; ++i) {
+      palettes[0].colors[i] = (EGAColor)i;
+      palettes[1].colors[i] = (EGAColor)(i + 16);
+   }
+
+   auto texture = textureCreateCustom(size.x, size.y, {});
+   u32 frame = 0;
+
+   _run(b, { "decode", storage, "palette", size, 0, 0, px, px * 4 }, [&] { egaTextureDecode(tex, texture, &palettes[++frame & 1]); });
+
+   // only one slot changes so the partial re-decode only touches that color
+   EGAPalette oneSlot = palettes[0];
+   egaTextureDecode(tex, texture, &oneSlot);
+   _run(b, { "decode", storage, "paletteSlot", size, 0, 0, px / 16, px / 16 * 4 }, [&] {
+      oneSlot.colors[5] = (EGAColor)((++frame & 1) ? 5 : 40);
+      egaTextureDecode(tex, texture, &oneSlot);
+   });
+
+   Recti dirty = { size.x / 3, size.y / 3, MIN(64, size.x), MIN(64, size.y) };
+   _run(b, { "decode", storage, "dirty64", size, 0, 0, (f64)dirty.w * dirty.h, (f64)dirty.w * dirty.h * 4 }, [&] {
+      egaRenderRect(tex, dirty, (EGAPColor)(++frame & 15));
+      egaTextureDecode(tex, texture, &oneSlot);
+   });
+   _run(b, { "decode", storage, "clean", size, 0, 0, 0, 0 }, [&] { egaTextureDecode(tex, texture, &oneSlot); });
+   textureDestroy(texture);
+
+   struct { const char *name; EGAScaleMode mode; u32 scale; } scaled[] = {
+      { "nearest1", EGAScaleMode_NEAREST, 1 },
+      { "nearest3", EGAScaleMode_NEAREST, 3 },
+      { "aspect2", EGAScaleMode_ASPECT, 2 },
+      { "scale2x", EGAScaleMode_SCALE2X, 2 },
+   };
+   for (auto &s : scaled) {
+      auto outSize = egaScaledSize(size, s.mode, s.scale);
+      auto outPx = (f64)outSize.x * outSize.y;
+      if (outPx > 64.0 * 1024 * 1024) {
+         continue; // 4k scale3 would be a 600MB buffer
+      }
+
+      std::vector<ColorRGBA> out((u64)outPx);
+      _run(b, { "decodeScaled", storage, s.name, size, 0, 0, outPx, outPx * 4 }, [&] {
+         egaTextureDecodeScaledToBuffer(tex, out.data(), &palettes[0], s.mode, s.scale);
+      });
+   }
+
+   egaTextureDestroy(tex);
+}
+
+static void _benchEncode(Bench &b, Int2 size) {
+   // smooth gradients with noise, lots of unique colors like a real photo would have
+   auto source = textureCreateCustom(size.x, size.y, {});
+   std::vector<ColorRGBA> pixels((u64)size.x * size.y);
+   u32 seed = 1;
+   for (i32 y = 0; y < size.y; ++y) {
+      for (i32 x = 0; x < size.x; ++x) {
+         seed = seed * 1664525u + 1013904223u;
+         auto &p = pixels[(u64)y * size.x + x];
+         p.r = (byte)(x * 255 / size.x + (seed >> 28));
+         p.g = (byte)(y * 255 / size.y + ((seed >> 24) & 15));
+         p.b = (byte)((x ^ y) + ((seed >> 20) & 15));
+         p.a = (seed >> 16) % 17 ? 255 : 0;
+      }
+   }
+   textureSetPixels(source, (byte*)pixels.data());
+
+   EGAPalette target, result;
+   memset(target.colors, EGA_COLOR_UNDEFINED, sizeof(target.colors));
+
+   auto px = (f64)size.x * size.y;
+   _run(b, { "encode", "", "rgba", size, 0, 0, px, px * 4 }, [&] {
+      auto tex = egaTextureCreateFromTextureEncode(source, &target, &result);
+      if (tex) {
+         egaTextureDestroy(tex);
+      }
+   });
+
+   // 8 palettes over 16x16 tiles, then decoding the result back through them
+   EGATilePalettes *tilePalettes = nullptr;
+   _run(b, { "encodeTilePalettes", "", "rgba", size, 0, 0, px, px * 4 }, [&] {
+      if (tilePalettes) {
+         egaTilePalettesDestroy(tilePalettes);
+      }
+      auto tex = egaTextureCreateFromTextureEncodeTilePalettes(source, { 16, 16 }, 8, &tilePalettes);
+      egaTextureDestroy(tex);
+   });
+
+   if (tilePalettes) {
+      egaTilePalettesDestroy(tilePalettes);
+   }
+   auto encoded = egaTextureCreateFromTextureEncodeTilePalettes(source, { 16, 16 }, 8, &tilePalettes);
+   std::vector<ColorRGBA> out((u64)size.x * size.y);
+   _run(b, { "decodeTilePalettes", "", "", size, 0, 0, px, px * 4 }, [&] {
+      egaTextureDecodeTilePalettesToBuffer(encoded, out.data(), tilePalettes);
+   });
+
+   // the native format both ways, the size column is the serialized buffer
+   struct { StringView name; EGATextureFormat format; } formats[] = {
+      { "packed", EGATextureFormat_PACKED }, { "spans", EGATextureFormat_SPANS }
+   };
+   for (auto &f : formats) {
+      byte *buff = nullptr;
+      u64 buffSize = 0;
+      if (!egaTextureSerialize(encoded, &buff, &buffSize, f.format)) {
+         continue;
+      }
+
+      _run(b, { "serialize", "", f.name, size, 0, 0, px, (f64)buffSize }, [&] {
+         byte *tmp = nullptr;
+         u64 tmpSize = 0;
+         egaTextureSerialize(encoded, &tmp, &tmpSize, f.format);
+         delete[] tmp;
+      });
+      _run(b, { "deserialize", "", f.name, size, 0, 0, px, (f64)buffSize }, [&] {
+         egaTextureDestroy(egaTextureDeserialize(buff, buffSize));
+      });
+      if (f.format == EGATextureFormat_PACKED) {
+         _run(b, { "packedView", "", f.name, size, 0, 0, px, (f64)buffSize }, [&] {
+            egaPackedTextureDestroy(egaPackedTextureCreateView(buff, buffSize));
+         });
+      }
+      delete[] buff;
+   }
+
+   egaTextureDestroy(encoded);
+   egaTilePalettesDestroy(tilePalettes);
+   textureDestroy(source);
+}
+
+// not a timing, egabench_quick runs under ctest so this makes sure serialize never writes what deserialize refuses
+// wider than 16k round trips since the cap is on pixels, a canvas over the cap fails to serialize at all
+static bool _checkSerializeLimits() {
+   bool ok = true;
+
+   auto wide = egaTextureCreateTiled(20000, 8);
+   egaRenderRect(wide, { 16500, 2, 100, 4 }, 9);
+
+   byte *buff = nullptr;
+   u64 buffSize = 0;
+   if (egaTextureSerialize(wide, &buff, &buffSize)) {
+      auto back = egaTextureDeserialize(buff, buffSize);
+      ok = back && egaTextureGetColorAt(back, 16550, 3) == 9 && egaTextureGetColorAt(back, 100, 3) == EGA_COLOR_UNDEFINED;
+      if (back) {
+         egaTextureDestroy(back);
+      }
+      delete[] buff;
+   }
+   else {
+      ok = false;
+   }
+   egaTextureDestroy(wide);
+
+   auto huge = egaTextureCreateTiled(20000, 20000);
+   egaRenderRect(huge, { 100, 100, 50, 50 }, 3);
+   if (egaTextureSerialize(huge, &buff, &buffSize)) {
+      ok = false;
+      delete[] buff;
+   }
+   egaTextureDestroy(huge);
+
+   if (!ok) {
+      fprintf(stderr, "serialize limits: a texture past 16k didn't round trip the way it should\n");
+   }
+   return ok;
+}
+
+// a document shaped like the game's asset files, lots of small nested records plus a big blob
+static void _scfWriteDocument(SCFWriter *writer, u32 records, std::vector<byte> const& blob) {
+   scfWriteListBegin(writer);
+   for (u32 i = 0; i < records; ++i) {
+      scfWriteListBegin(writer);
+      scfWriteInt(writer, (i32)i);
+      scfWriteFloat(writer, i * 0.5f);
+      scfWriteString(writer, "record");
+      scfWriteBytes(writer, blob.data(), 64);
+
+      // a few levels deep so nesting costs show up
+      for (u32 d = 0; d < 4; ++d) { scfWriteListBegin(writer); scfWriteInt(writer, (i32)d); }
+      for (u32 d = 0; d < 4; ++d) { scfWriteListEnd(writer); }
+
+      scfWriteListEnd(writer);
+   }
+   scfWriteListEnd(writer);
+   scfWriteBytes(writer, blob.data(), (u32)blob.size());
+}
+
+static u64 _scfWalk(SCFReader &view) {
+   u64 acc = 0;
+   while (!scfReaderAtEnd(view)) {
+      switch (scfReaderPeek(view)) {
+      case SCFType_INT: acc += *scfReadInt(view); break;
+      case SCFType_FLOAT: acc += (u64)*scfReadFloat(view); break;
+      case SCFType_STRING: acc += scfReadString(view)[0]; break;
+      case SCFType_BYTES: { u32 size = 0; scfReadBytes(view, &size); acc += size; } break;
+      case SCFType_SUBLIST: { auto list = scfReadList(view); acc += _scfWalk(list); } break;
+      default: scfReaderSkip(view); break;
+      }
+   }
+   return acc;
+}
+
+static void _benchSCF(Bench &b, u32 records, u32 blobSize) {
+   std::vector<byte> blob(blobSize);
+   for (u32 i = 0; i < blobSize; ++i) {
+      blob[i] = (byte)(i * 31);
+   }
+
+   u32 bufferSize = 0;
+   {
+      auto writer = scfWriterCreate();
+      _scfWriteDocument(writer, records, blob);
+      delete[] (byte*)scfWriteToBuffer(writer, &bufferSize);
+      scfWriterDestroy(writer);
+   }
+
+   auto clip = format("%urecords_%ukb", records, blobSize / 1024);
+   _run(b, { "scfWrite", "", clip, { 0 }, 0, 0, 0, (f64)bufferSize }, [&] {
+      auto writer = scfWriterCreate();
+      _scfWriteDocument(writer, records, blob);
+      u32 size = 0;
+      delete[] (byte*)scfWriteToBuffer(writer, &size);
+      scfWriterDestroy(writer);
+   });
+
+   auto writer = scfWriterCreate();
+   _scfWriteDocument(writer, records, blob);
+   auto buffer = scfWriteToBuffer(writer, &bufferSize);
+   scfWriterDestroy(writer);
+
+   u64 sink = 0;
+   _run(b, { "scfRead", "", clip, { 0 }, 0, 0, 0, (f64)bufferSize }, [&] {
+      auto view = scfView(buffer);
+      sink += _scfWalk(view);
+   });
+
+   // same walk over a file mapping, which is how assets get loaded
+   auto tempPath = format("egabench_%s.scf", clip.c_str());
+   if (fileWrite(tempPath.c_str(), buffer, bufferSize)) {
+      _run(b, { "scfReadMapped", "", clip, { 0 }, 0, 0, 0, (f64)bufferSize }, [&] {
+         auto file = fileMap(tempPath.c_str());
+         auto view = scfViewBuffer(fileGetData(file), fileGetSize(file));
+         sink += _scfWalk(view);
+         fileUnmap(file);
+      });
+      remove(tempPath.c_str());
+   }
+   delete[] (byte*)buffer;
+
+   if (sink == 1) {
+      printf("\n"); // keeps the walk from getting optimized out
+   }
+}
+
+#pragma endregion
+
+int main(int argc, char** argv) {
+   Bench b;
+   for (int i = 1; i < argc; ++i) {
+      if (!strcmp(argv[i], "-quick")) {
+         b.config.quick = true;
+         b.config.batchNs = 1e5;
+         b.config.batches = 1;
+      }
+      else if (!strcmp(argv[i], "-time") && i + 1 < argc) {
+         b.config.batchNs = atof(argv[++i]) * 1e6;
+      }
+      else if (!strcmp(argv[i], "-filter") && i + 1 < argc) {
+         b.config.filter = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-json") && i + 1 < argc) {
+         b.config.jsonPath = argv[++i];
+      }
+      else {
+         fprintf(stderr, "usage: %s [-quick] [-time ms] [-filter substring] [-json out.json]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   egaStartup();
+
+   if (!_checkSerializeLimits()) {
+      return 1;
+   }
+
+   std::vector<Int2> sizes = { { EGA_RES_WIDTH, EGA_RES_HEIGHT }, { 1280, 800 }, { 4096, 4096 } };
+   if (b.config.quick) {
+      sizes = { { EGA_RES_WIDTH, EGA_RES_HEIGHT } };
+   }
+
+   for (auto size : sizes) {
+      for (int tiled = 0; tiled < 2; ++tiled) {
+         _benchPrimitives(b, size, tiled != 0);
+         _benchDecode(b, size, tiled != 0);
+      }
+
+      _benchEncode(b, size);
+   }
+
+   _benchSCF(b, 1000, 64 * 1024);
+   if (!b.config.quick) {
+      _benchSCF(b, 20000, 4 * 1024 * 1024);
+   }
+
+   if (!b.config.jsonPath.empty()) {
+      if (!_writeJSON(b)) {
+         fprintf(stderr, "couldn't write %s\n", b.config.jsonPath.c_str());
+         return 1;
+      }
+      printf("wrote %u results to %s\n", (u32)b.results.size(), b.config.jsonPath.c_str());
+   }
+
+   return 0;
+}
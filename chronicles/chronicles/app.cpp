@@ -7,11 +7,13 @@
 
 #include "imgui_impl_sdl_gl3.h"
 #include "game.h"
+#include "capture.h"
 
 #include "math.h"
 
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <functional>
 
 #include "IconsFontAwesome.h"
@@ -35,15 +37,17 @@ struct Window {
 };
 
 struct App {
+   AppConfig config;
    bool running = false;
    Window* wnd = nullptr;
-   ImFontAtlas* fontAtlas;
+   ImFontAtlas* fontAtlas = nullptr;
 
    Game* game;   
 };
 
 App* appCreate(AppConfig const& config) {
    auto out = new App();
+   out->config = config;
    out->game = gameCreate(config.assetFolder);
    return out;
 }
@@ -51,14 +55,17 @@ App* appCreate(AppConfig const& config) {
 void appDestroy(App* app) {
    gameDestroy(app->game);
 
-   ImGui_ImplSdlGL3_Shutdown();
-   ImGui::DestroyContext();
+   if (app->wnd) {
+      ImGui_ImplSdlGL3_Shutdown();
+      ImGui::DestroyContext();
+
+      SDL_GL_DeleteContext(app->wnd->sdlCtx);
+      SDL_DestroyWindow(app->wnd->sdlWnd);
+      SDL_Quit();
 
-   SDL_GL_DeleteContext(app->wnd->sdlCtx);
-   SDL_DestroyWindow(app->wnd->sdlWnd);
-   SDL_Quit();
+      delete app->wnd;
+   }
 
-   delete app->wnd;
    delete app->fontAtlas;
    delete app;
 }
@@ -243,6 +250,29 @@ void appStep(App* app) {
    _renderFrame(app);
 }
 
+void appRunHeadless(App* app) {
+   FrameCapture *capture = nullptr;
+   if (app->config.captureFolder) {
+      CaptureConfig cfg;
+      cfg.folder = app->config.captureFolder;
+      cfg.format = app->config.captureRaw ? CaptureFormat_RAW : CaptureFormat_PNG;
+      capture = captureCreate(cfg);
+   }
+
+   auto data = gameData(app->game);
+   for (u32 frame = 0; frame < app->config.headlessFrames; ++frame) {
+      gameStep(app->game, 1.0f / 60.0f);
+
+      if (capture) {
+         captureFrame(capture, data->primaryView.egaTexture, &data->primaryView.palette);
+      }
+   }
+
+   if (capture) {
+      captureDestroy(capture);
+   }
+}
+
 
 // Window
 Int2 windowSize(Window* wnd) { return wnd->size; }
@@ -290,6 +320,7 @@ struct Texture {
    Int2 size = { 0 };
 
    bool dirty = true;
+   std::vector<Recti> dirtyRegions; // partial uploads, only used while dirty is false
 };
 
 static void _textureRelease(Texture *self) {
@@ -443,6 +474,30 @@ void textureDestroy(Texture *self) {
 void textureSetPixels(Texture *self, byte *data) {
    memcpy(self->pixels, data, self->size.x * self->size.y * sizeof(ColorRGBA));
    self->dirty = true;
+   self->dirtyRegions.clear();
+}
+void textureSetPixelsRegions(Texture *self, byte *data, Recti const *regions, u32 count) {
+   auto src = (ColorRGBA*)data;
+   for (u32 i = 0; i < count; ++i) {
+      auto &r = regions[i];
+      for (i32 y = r.y; y < r.y + r.h; ++y) {
+         auto offset = y * self->size.x + r.x;
+         memcpy(self->pixels + offset, src + offset, r.w * sizeof(ColorRGBA));
+      }
+   }
+
+   if (self->dirty) {
+      return; // full upload pending anyway
+   }
+
+   // if these pile up between uploads just send the whole thing
+   if (self->dirtyRegions.size() + count > 64) {
+      self->dirty = true;
+      self->dirtyRegions.clear();
+      return;
+   }
+
+   self->dirtyRegions.insert(self->dirtyRegions.end(), regions, regions + count);
 }
 Int2 textureGetSize(Texture *t) {
    return t->size;
@@ -459,6 +514,18 @@ uPtr textureGetHandle(Texture *self) {
       glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, self->size.x, self->size.y, GL_RGBA, GL_UNSIGNED_BYTE, self->pixels);
       glBindTexture(GL_TEXTURE_2D, 0);
       self->dirty = false;
+      self->dirtyRegions.clear();
+   }
+   else if (!self->dirtyRegions.empty()) {
+      // row length lets us upload sub-rects straight out of the full pixel buffer
+      glBindTexture(GL_TEXTURE_2D, self->glHandle);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, self->size.x);
+      for (auto &r : self->dirtyRegions) {
+         glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, GL_RGBA, GL_UNSIGNED_BYTE, self->pixels + (r.y * self->size.x + r.x));
+      }
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      self->dirtyRegions.clear();
    }
 
    return self->glHandle;
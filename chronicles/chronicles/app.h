@@ -2,6 +2,7 @@
 
 #include "defs.h"
 #include "math.h"
+#include "texture.h"
 
 #include <functional>
 
@@ -15,6 +16,13 @@
 
 struct AppConfig {
    const char* assetFolder = nullptr;
+
+   // headless runs step the game with no window or GL for a fixed number of frames
+   // and optionally capture every frame of the primary view
+   bool headless = false;
+   u32 headlessFrames = 60;
+   const char* captureFolder = nullptr;
+   bool captureRaw = false; // index/palette dumps instead of pngs
 };
 
 // APP
@@ -32,6 +40,9 @@ bool appRunning(App* app);
 //void appPollEvents(App* app);
 void appStep(App* app);
 
+// runs config.headlessFrames game steps at a fixed 60hz, no window needed
+void appRunHeadless(App* app);
+
 void appDestroy(App* app);
 
 // Window
@@ -47,45 +58,3 @@ void windowClose(Window*wnd);
 // label must be unique or this call is ignored
 void windowAddGUI(Window* wnd, StringView label, std::function<bool(Window*)> gui);
 u64 DEBUG_windowGetDialogCount(Window* wnd);
-
-
-// Rendering
-enum {
-   RepeatType_REPEAT,
-   RepeatType_CLAMP
-};
-typedef byte RepeatType;
-
-enum {
-   FilterType_LINEAR,
-   FilterType_NEAREST
-};
-typedef byte FilterType;
-
-typedef struct {
-   RepeatType repeatType = RepeatType_CLAMP;
-   FilterType filterType = FilterType_NEAREST;
-} TextureConfig;
-
-typedef struct Texture Texture;
-
-enum {
-   TextureFromBufferFlag_REFERENCE = 0, // do nothing with the input buffer, assume its life outlasts the texture
-   TextureFromBufferFlag_TAKE_OWNERHSIP,// Call free on the buffer on texture destroy
-   TextureFromBufferFlag_COPY           // memcpy out
-};
-typedef byte TextureFromBufferFlag;
-
-Texture *textureCreateFromPath(StringView path, TextureConfig const& config);
-Texture *textureCreateFromBuffer(byte* buffer, u64 size, TextureConfig const& config, TextureFromBufferFlag flag = 0);
-Texture *textureCreateCustom(u32 width, u32 height, TextureConfig const& config);
-void textureDestroy(Texture *self);
-
-void textureSetPixels(Texture *self, byte *data);
-Int2 textureGetSize(Texture *t);
-
-//because why not
-uPtr textureGetHandle(Texture *self);
-
-const ColorRGBA *textureGetPixels(Texture *self);
-
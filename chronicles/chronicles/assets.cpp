@@ -0,0 +1,142 @@
+#include "assets.h"
+#include "file.h"
+#include "scf.h"
+
+#include <string.h>
+#include <unordered_map>
+
+static const StringView PalettePath = "pal.bin";
+
+struct Assets {
+   StringView assetsFolder = nullptr;
+
+   std::unordered_map<std::string, EGAPalette*> palettes;
+};
+
+static std::string _assetPath(Assets *assets, StringView path) {
+   return assets->assetsFolder ? format("%s/%s", assets->assetsFolder, path) : path;
+}
+
+// reads straight out of the mapping, only the palettes themselves get copied
+static void _readPalettes(Assets *assets, SCFReader view) {
+   while (!scfReaderAtEnd(view)) {
+      SCFReader kvp = scfReadList(view);
+      if (scfReaderNull(kvp)) {
+         return;
+      }
+
+      std::string key;
+      EGAPalette value;
+
+      if (auto k = scfReadString(kvp)) {
+         key = k;
+      }
+      else {
+         return;
+      }
+
+      u32 byteCount = 0;
+      if (auto bytes = scfReadBytes(kvp, &byteCount)) {
+         if (byteCount == sizeof(EGAPalette)) {
+            value = *(EGAPalette*)bytes;
+         }
+      }
+      else {
+         return;
+      }
+
+      if (auto existing = assetsPaletteRetrieve(assets, key.c_str())) {
+         *existing = value;
+      }
+      else {
+         EGAPalette *newPal = new EGAPalette;
+         *newPal = value;
+         assets->palettes.insert({ key, newPal });
+      }
+   }
+}
+
+static void _loadPalettes(Assets *assets) {
+   auto file = fileMap(_assetPath(assets, PalettePath).c_str());
+   if (!file) {
+      return;
+   }
+
+   auto view = scfViewBuffer(fileGetData(file), fileGetSize(file));
+   if (!scfReaderNull(view)) {
+      _readPalettes(assets, view);
+   }
+
+   fileUnmap(file);
+}
+
+static void _savePalettes(Assets* assets) {
+   auto writer = scfWriterCreate();
+
+   for (auto &p : assets->palettes) {
+      scfWriteListBegin(writer);
+      scfWriteString(writer, p.first.c_str());
+      scfWriteBytes(writer, (byte*)p.second, sizeof(EGAPalette));
+      scfWriteListEnd(writer);
+   }
+
+   u32 bSize = 0;
+   auto out = scfWriteToBuffer(writer, &bSize);
+   fileWrite(_assetPath(assets, PalettePath).c_str(), out, bSize);
+   delete[] (byte*)out;
+
+   scfWriterDestroy(writer);
+}
+
+Assets *assetsCreate(StringView assetsFolder) {
+   auto out = new Assets();
+   out->assetsFolder = assetsFolder;
+
+   _loadPalettes(out);
+   return out;
+}
+
+void assetsDestroy(Assets* assets) {
+   for (auto &p : assets->palettes) {
+      delete p.second;
+   }
+
+   delete assets;
+}
+
+void assetsPaletteStore(Assets *assets, StringView name, EGAPalette *pal) {
+   if (auto existing = assetsPaletteRetrieve(assets, name)) {
+      *existing = *pal;
+   }
+   else {
+      EGAPalette *newPal = new EGAPalette;
+      *newPal = *pal;
+      assets->palettes.insert({ name, newPal });
+   }
+   _savePalettes(assets);
+}
+void assetsPaletteDelete(Assets *assets, StringView name) {
+   if (auto existing = assetsPaletteRetrieve(assets, name)) {
+      delete existing;
+      assets->palettes.erase(name);
+   }
+   
+   _savePalettes(assets);
+}
+EGAPalette *assetsPaletteRetrieve(Assets *assets, StringView name) {
+   auto found = assets->palettes.find(name);
+   if (found != assets->palettes.end()) {
+      return found->second;
+   }
+   return nullptr;
+}
+std::vector<std::string> assetsPaletteGetList(Assets *assets, StringView search) {
+   std::vector<std::string> out;
+   auto searchlen = search ? strlen(search) : 0;
+   for (auto p : assets->palettes) {
+      if (searchlen == 0 || p.first.find(search) != std::string::npos) {
+         out.push_back(p.first);
+      }
+   }
+   return out;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "defs.h"
+#include "ega.h"
+
+#include <vector>
+#include <string>
+
+// Assets
+// everything loaded out of the asset folder, no window or GL needed so tools can load them too
+
+typedef struct Assets Assets;
+
+Assets *assetsCreate(StringView assetsFolder); // loads what's in the folder, null folder is the cwd
+void assetsDestroy(Assets *assets);
+
+void        assetsPaletteStore(Assets *assets, StringView name, EGAPalette *pal);
+void        assetsPaletteDelete(Assets *assets, StringView name);
+EGAPalette *assetsPaletteRetrieve(Assets *assets, StringView name);
+std::vector<std::string> assetsPaletteGetList(Assets *assets, StringView search = nullptr);
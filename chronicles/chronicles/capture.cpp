@@ -0,0 +1,163 @@
+#include "capture.h"
+
+#include <stb/stb_image_write.h>
+
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct CaptureFrame {
+   u32 index = 0;
+   Int2 size = { 0 };
+   EGAPalette palette;
+   std::vector<byte> data; // rgba for png, indices for raw
+};
+
+struct FrameCapture {
+   CaptureConfig config;
+   std::string folder;
+
+   std::thread writer;
+   std::mutex lock;
+   std::condition_variable wake;    // writer waits on frames
+   std::condition_variable room;    // captureFrame waits on space
+
+   std::deque<CaptureFrame*> queue;
+   std::vector<CaptureFrame*> spare; // written frames get their buffers reused
+   bool stopping = false;
+
+   u32 nextIndex = 0;
+   u32 written = 0, dropped = 0, failed = 0;
+};
+
+static bool _writeRaw(std::string const& path, CaptureFrame const *frame) {
+   auto f = fopen(path.c_str(), "wb");
+   if (!f) {
+      return false;
+   }
+
+   u32 dims[2] = { (u32)frame->size.x, (u32)frame->size.y };
+   bool ok = fwrite("EGAF", 4, 1, f) == 1 &&
+      fwrite(dims, sizeof(dims), 1, f) == 1 &&
+      fwrite(frame->palette.colors, sizeof(frame->palette.colors), 1, f) == 1 &&
+      fwrite(frame->data.data(), frame->data.size(), 1, f) == 1;
+
+   fclose(f);
+   return ok;
+}
+
+static bool _writeFrame(FrameCapture *self, CaptureFrame const *frame) {
+   if (self->config.format == CaptureFormat_RAW) {
+      return _writeRaw(format("%s/frame_%05u.ega", self->folder.c_str(), frame->index), frame);
+   }
+
+   auto path = format("%s/frame_%05u.png", self->folder.c_str(), frame->index);
+   return stbi_write_png(path.c_str(), frame->size.x, frame->size.y, 4, frame->data.data(), frame->size.x * sizeof(ColorRGBA)) != 0;
+}
+
+static void _writerThread(FrameCapture *self) {
+   std::unique_lock<std::mutex> lk(self->lock);
+   while (true) {
+      self->wake.wait(lk, [=] { return self->stopping || !self->queue.empty(); });
+      if (self->queue.empty()) {
+         return; // only stop once everything queued is out
+      }
+
+      auto frame = self->queue.front();
+      self->queue.pop_front();
+
+      lk.unlock();
+      bool ok = _writeFrame(self, frame);
+      lk.lock();
+
+      ++(ok ? self->written : self->failed);
+      self->spare.push_back(frame);
+      self->room.notify_one();
+   }
+}
+
+FrameCapture *captureCreate(CaptureConfig const& config) {
+   auto self = new FrameCapture();
+   self->config = config;
+   self->config.queueDepth = MAX(config.queueDepth, 1u);
+   self->folder = config.folder ? config.folder : ".";
+   self->writer = std::thread(_writerThread, self);
+   return self;
+}
+
+void captureDestroy(FrameCapture *self) {
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      self->stopping = true;
+   }
+   self->wake.notify_one();
+   self->writer.join();
+
+   for (auto frame : self->spare) {
+      delete frame;
+   }
+   delete self;
+}
+
+bool captureFrame(FrameCapture *self, EGATexture const *frame, EGAPalette const *palette) {
+   CaptureFrame *out = nullptr;
+   {
+      std::unique_lock<std::mutex> lk(self->lock);
+      if (self->queue.size() >= self->config.queueDepth) {
+         if (self->config.dropWhenFull) {
+            ++self->dropped;
+            ++self->nextIndex;
+            return false;
+         }
+         self->room.wait(lk, [=] { return self->queue.size() < self->config.queueDepth; });
+      }
+
+      if (!self->spare.empty()) {
+         out = self->spare.back();
+         self->spare.pop_back();
+      }
+   }
+
+   if (!out) {
+      out = new CaptureFrame();
+   }
+
+   // decoding happens here so the writer only ever sees finished data
+   auto size = egaTextureGetSize(frame);
+   out->index = self->nextIndex++;
+   out->palette = *palette;
+
+   if (self->config.format == CaptureFormat_RAW) {
+      out->size = size;
+      out->data.resize((u64)size.x * size.y);
+      egaTextureGetIndices(frame, out->data.data());
+   }
+   else {
+      out->size = egaScaledSize(size, self->config.scaleMode, self->config.scale);
+      out->data.resize((u64)out->size.x * out->size.y * sizeof(ColorRGBA));
+      egaTextureDecodeScaledToBuffer(frame, (ColorRGBA*)out->data.data(), palette, self->config.scaleMode, self->config.scale);
+   }
+
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      self->queue.push_back(out);
+   }
+   self->wake.notify_one();
+   return true;
+}
+
+u32 captureGetWrittenCount(FrameCapture *self) {
+   std::lock_guard<std::mutex> lk(self->lock);
+   return self->written;
+}
+u32 captureGetDroppedCount(FrameCapture *self) {
+   std::lock_guard<std::mutex> lk(self->lock);
+   return self->dropped;
+}
+u32 captureGetFailedCount(FrameCapture *self) {
+   std::lock_guard<std::mutex> lk(self->lock);
+   return self->failed;
+}
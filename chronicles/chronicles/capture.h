@@ -0,0 +1,42 @@
+#pragma once
+
+#include "defs.h"
+#include "ega.h"
+
+// Frame capture, frames get decoded on the calling thread and handed to a background writer
+// so png encoding and disk never hold up the frame loop
+
+enum CaptureFormat_ {
+   CaptureFormat_PNG = 0,  // <folder>/frame_00000.png, decoded and scaled
+   CaptureFormat_RAW       // <folder>/frame_00000.ega, the palette indices and palette as-is
+};
+typedef byte CaptureFormat;
+
+/*
+raw frames:
+- "EGAF"
+- u32 width, u32 height
+- 16 byte palette (EGA colors)
+- width*height palette indices, row-major, EGA_ALPHA for transparent
+*/
+
+struct CaptureConfig {
+   StringView folder = ".";
+   CaptureFormat format = CaptureFormat_PNG;
+   EGAScaleMode scaleMode = EGAScaleMode_NEAREST; // png only
+   u32 scale = 1;
+   u32 queueDepth = 8;        // frames waiting on the writer
+   bool dropWhenFull = false; // otherwise captureFrame waits for room (regression runs want every frame)
+};
+
+typedef struct FrameCapture FrameCapture;
+
+FrameCapture *captureCreate(CaptureConfig const& config);
+void captureDestroy(FrameCapture *self); // finishes writing whatever is queued first
+
+// returns false if the frame got dropped
+bool captureFrame(FrameCapture *self, EGATexture const *frame, EGAPalette const *palette);
+
+u32 captureGetWrittenCount(FrameCapture *self);
+u32 captureGetDroppedCount(FrameCapture *self);
+u32 captureGetFailedCount(FrameCapture *self); // write errors
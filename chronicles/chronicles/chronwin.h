@@ -17,7 +17,4 @@ std::string openFile(OpenFileConfig const& config);
 
 std::string cwd();
 
-byte *readFullFile(StringView path, u64 *fsize);
-int writeBinaryFile(StringView path, byte* buffer, u64 size);
-
 std::string pathGetFilename(StringView path);
\ No newline at end of file
@@ -1,10 +1,27 @@
 #include "ega.h"
-#include "app.h"
+#include "scf.h"
+#include "texture.h"
 
 #include <string.h>
-#include <list>
+#include <math.h>
+#include <float.h>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define EGA_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define EGA_TARGET(arch)
+#else
+#define EGA_TARGET(arch) __attribute__((target(arch)))
+#endif
+#endif
 
 byte getBit(byte dest, byte pos/*0-7*/) {
    return !!(dest & (1 << (pos & 7)));
@@ -32,9 +49,255 @@ static void _buildColorTable(ColorRGB *table) {
    }
 }
 
+#pragma region DECODE KERNELS
+
+// palette resolved down to the final rgba per index, built once per decode
+// the planar copies are what the shuffle kernels use as their tables
+struct EGADecodeLUT {
+   ColorRGBA colors[EGA_PALETTE_COLORS];
+   byte r[EGA_PALETTE_COLORS], g[EGA_PALETTE_COLORS], b[EGA_PALETTE_COLORS];
+};
+
+// decodes count index bytes from src into dest, anything >= EGA_PALETTE_COLORS is transparent
+typedef void(*EGADecodeKernel)(byte const *src, ColorRGBA *dest, u32 count, EGADecodeLUT const &lut);
+
+static void _decodeKernelScalar(byte const *src, ColorRGBA *dest, u32 count, EGADecodeLUT const &lut) {
+   for (u32 i = 0; i < count; ++i) {
+      auto c = src[i];
+      dest[i] = c < EGA_PALETTE_COLORS ? lut.colors[c] : ColorRGBA{ 0 };
+   }
+}
+
+#ifdef EGA_X86
+
+// 16 pixels per iteration, pshufb does the palette lookup for each channel
+EGA_TARGET("ssse3")
+static void _decodeKernelSSSE3(byte const *src, ColorRGBA *dest, u32 count, EGADecodeLUT const &lut) {
+   __m128i rTab = _mm_loadu_si128((__m128i const*)lut.r);
+   __m128i gTab = _mm_loadu_si128((__m128i const*)lut.g);
+   __m128i bTab = _mm_loadu_si128((__m128i const*)lut.b);
+   __m128i maxIdx = _mm_set1_epi8(EGA_PALETTE_COLORS - 1);
+   __m128i ones = _mm_set1_epi8(-1);
+
+   u32 i = 0;
+   for (; i + 16 <= count; i += 16) {
+      __m128i idx = _mm_loadu_si128((__m128i const*)(src + i));
+
+      // opaque lanes are 0xFF which doubles as the alpha channel
+      // transparent lanes get their high bit set so pshufb zeroes them
+      __m128i opaque = _mm_cmpeq_epi8(_mm_min_epu8(idx, maxIdx), idx);
+      __m128i sel = _mm_or_si128(idx, _mm_xor_si128(opaque, ones));
+
+      __m128i r = _mm_shuffle_epi8(rTab, sel);
+      __m128i g = _mm_shuffle_epi8(gTab, sel);
+      __m128i b = _mm_shuffle_epi8(bTab, sel);
+
+      __m128i rg0 = _mm_unpacklo_epi8(r, g), rg1 = _mm_unpackhi_epi8(r, g);
+      __m128i ba0 = _mm_unpacklo_epi8(b, opaque), ba1 = _mm_unpackhi_epi8(b, opaque);
+
+      __m128i *out = (__m128i*)(dest + i);
+      _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rg0, ba0));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg0, ba0));
+      _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg1, ba1));
+      _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg1, ba1));
+   }
+
+   _decodeKernelScalar(src + i, dest + i, count - i, lut);
+}
+
+// same as above on 32 pixels, the unpacks stay within 128-bit lanes so the halves get swizzled back on store
+EGA_TARGET("avx2")
+static void _decodeKernelAVX2(byte const *src, ColorRGBA *dest, u32 count, EGADecodeLUT const &lut) {
+   __m256i rTab = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const*)lut.r));
+   __m256i gTab = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const*)lut.g));
+   __m256i bTab = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const*)lut.b));
+   __m256i maxIdx = _mm256_set1_epi8(EGA_PALETTE_COLORS - 1);
+   __m256i ones = _mm256_set1_epi8(-1);
+
+   u32 i = 0;
+   for (; i + 32 <= count; i += 32) {
+      __m256i idx = _mm256_loadu_si256((__m256i const*)(src + i));
+
+      __m256i opaque = _mm256_cmpeq_epi8(_mm256_min_epu8(idx, maxIdx), idx);
+      __m256i sel = _mm256_or_si256(idx, _mm256_xor_si256(opaque, ones));
+
+      __m256i r = _mm256_shuffle_epi8(rTab, sel);
+      __m256i g = _mm256_shuffle_epi8(gTab, sel);
+      __m256i b = _mm256_shuffle_epi8(bTab, sel);
+
+      __m256i rg0 = _mm256_unpacklo_epi8(r, g), rg1 = _mm256_unpackhi_epi8(r, g);
+      __m256i ba0 = _mm256_unpacklo_epi8(b, opaque), ba1 = _mm256_unpackhi_epi8(b, opaque);
+
+      // each of these holds pixels n..n+3 in the low lane and n+16..n+19 in the high
+      __m256i p0 = _mm256_unpacklo_epi16(rg0, ba0);
+      __m256i p4 = _mm256_unpackhi_epi16(rg0, ba0);
+      __m256i p8 = _mm256_unpacklo_epi16(rg1, ba1);
+      __m256i p12 = _mm256_unpackhi_epi16(rg1, ba1);
+
+      __m256i *out = (__m256i*)(dest + i);
+      _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p4, 0x20));
+      _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p8, p12, 0x20));
+      _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p4, 0x31));
+      _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p8, p12, 0x31));
+   }
+
+   _decodeKernelSSSE3(src + i, dest + i, count - i, lut);
+}
+
+static bool _cpuHasSSSE3() {
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 1);
+   return (info[2] & (1 << 9)) != 0;
+#else
+   return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static bool _cpuHasAVX2() {
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 1);
+   bool osxsave = (info[2] & (1 << 27)) != 0;
+   bool avx = (info[2] & (1 << 28)) != 0;
+   if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+      return false; // OS isnt saving ymm state
+   }
+
+   __cpuidex(info, 7, 0);
+   return (info[1] & (1 << 5)) != 0;
+#else
+   return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static EGADecodeKernel g_decodeKernel = _decodeKernelScalar;
+
+static void _selectDecodeKernel() {
+#ifdef EGA_X86
+   if (_cpuHasAVX2()) {
+      g_decodeKernel = _decodeKernelAVX2;
+   }
+   else if (_cpuHasSSSE3()) {
+      g_decodeKernel = _decodeKernelSSSE3;
+   }
+#endif
+}
+
+#pragma endregion
+
+#pragma region REMAP KERNELS
+
+// every palette index goes through map, transparent bytes become alpha if alphaReplace otherwise theyre left alone
+struct EGARemapLUT {
+   byte map[EGA_PALETTE_COLORS];
+   byte alpha = EGA_ALPHA;
+   bool alphaReplace = false;
+};
+
+// remaps count index bytes in place, returns true if any of them changed
+typedef bool(*EGARemapKernel)(byte *pixels, u32 count, EGARemapLUT const &lut);
+
+static bool _remapKernelScalar(byte *pixels, u32 count, EGARemapLUT const &lut) {
+   byte diff = 0;
+   for (u32 i = 0; i < count; ++i) {
+      byte c = pixels[i];
+      byte out = c < EGA_PALETTE_COLORS ? lut.map[c] : (lut.alphaReplace ? lut.alpha : c);
+      diff |= out ^ c;
+      pixels[i] = out;
+   }
+   return diff != 0;
+}
+
+#ifdef EGA_X86
+
+// 16 pixels per iteration, pshufb is the lookup and transparent lanes get blended back in after
+EGA_TARGET("ssse3")
+static bool _remapKernelSSSE3(byte *pixels, u32 count, EGARemapLUT const &lut) {
+   __m128i tab = _mm_loadu_si128((__m128i const*)lut.map);
+   __m128i maxIdx = _mm_set1_epi8(EGA_PALETTE_COLORS - 1);
+   __m128i alpha = _mm_set1_epi8((char)lut.alpha);
+   __m128i keep = _mm_set1_epi8(lut.alphaReplace ? 0 : -1);
+   __m128i diff = _mm_setzero_si128();
+
+   u32 i = 0;
+   for (; i + 16 <= count; i += 16) {
+      __m128i idx = _mm_loadu_si128((__m128i const*)(pixels + i));
+
+      __m128i opaque = _mm_cmpeq_epi8(_mm_min_epu8(idx, maxIdx), idx);
+      __m128i mapped = _mm_shuffle_epi8(tab, idx);
+      __m128i trans = _mm_or_si128(_mm_and_si128(keep, idx), _mm_andnot_si128(keep, alpha));
+      __m128i out = _mm_or_si128(_mm_and_si128(opaque, mapped), _mm_andnot_si128(opaque, trans));
+
+      diff = _mm_or_si128(diff, _mm_xor_si128(out, idx));
+      _mm_storeu_si128((__m128i*)(pixels + i), out);
+   }
+
+   bool changed = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF;
+   return _remapKernelScalar(pixels + i, count - i, lut) || changed;
+}
+
+EGA_TARGET("avx2")
+static bool _remapKernelAVX2(byte *pixels, u32 count, EGARemapLUT const &lut) {
+   __m256i tab = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const*)lut.map));
+   __m256i maxIdx = _mm256_set1_epi8(EGA_PALETTE_COLORS - 1);
+   __m256i alpha = _mm256_set1_epi8((char)lut.alpha);
+   __m256i keep = _mm256_set1_epi8(lut.alphaReplace ? 0 : -1);
+   __m256i diff = _mm256_setzero_si256();
+
+   u32 i = 0;
+   for (; i + 32 <= count; i += 32) {
+      __m256i idx = _mm256_loadu_si256((__m256i const*)(pixels + i));
+
+      __m256i opaque = _mm256_cmpeq_epi8(_mm256_min_epu8(idx, maxIdx), idx);
+      __m256i mapped = _mm256_shuffle_epi8(tab, idx);
+      __m256i trans = _mm256_blendv_epi8(alpha, idx, keep);
+      __m256i out = _mm256_blendv_epi8(trans, mapped, opaque);
+
+      diff = _mm256_or_si256(diff, _mm256_xor_si256(out, idx));
+      _mm256_storeu_si256((__m256i*)(pixels + i), out);
+   }
+
+   bool changed = !_mm256_testz_si256(diff, diff);
+   return _remapKernelSSSE3(pixels + i, count - i, lut) || changed;
+}
+
+#endif
+
+static EGARemapKernel g_remapKernel = _remapKernelScalar;
+
+static void _selectRemapKernel() {
+#ifdef EGA_X86
+   if (_cpuHasAVX2()) {
+      g_remapKernel = _remapKernelAVX2;
+   }
+   else if (_cpuHasSSSE3()) {
+      g_remapKernel = _remapKernelSSSE3;
+   }
+#endif
+}
+
+#pragma endregion
+
 ColorRGB g_egaToRGBTable[64] = { 0 };
 void egaStartup() {
    _buildColorTable(g_egaToRGBTable);
+   _selectDecodeKernel();
+   _selectRemapKernel();
+}
+
+static void _buildDecodeLUT(EGAPalette const *palette, EGADecodeLUT &lut) {
+   for (u32 i = 0; i < EGA_PALETTE_COLORS; ++i) {
+      auto c = palette->colors[i];
+      ColorRGB rgb = c < EGA_COLORS ? egaGetColor(c) : ColorRGB{ 0 }; // encode sentinels show as black
+
+      lut.colors[i] = ColorRGBA{ rgb.r, rgb.g, rgb.b, 255 };
+      lut.r[i] = rgb.r;
+      lut.g[i] = rgb.g;
+      lut.b[i] = rgb.b;
+   }
 }
 
 //EGAColor egaReduceRGB(ColorRGB c) {
@@ -54,25 +317,399 @@ a pixel cannot both have color and be transparent
 enum Tex_ {
    Tex_DECODE_DIRTY = (1 << 0),
    Tex_OFFSET_DIRTY = (1 << 1),
-   Tex_ALL_DIRTY = (Tex_DECODE_DIRTY | Tex_OFFSET_DIRTY)
+   Tex_SPANS_DIRTY = (1 << 2),
+   Tex_ALL_DIRTY = (Tex_DECODE_DIRTY | Tex_OFFSET_DIRTY | Tex_SPANS_DIRTY)
 };
 typedef byte TexCleanFlag;
 
+// a run of opaque pixels within a row
+struct EGASpan {
+   u32 x, len;
+};
+
+#define EGA_TILE_SHIFT 6
+#define EGA_TILE_SIZE (1 << EGA_TILE_SHIFT)
+
+// tiled texture storage, tile pointers grouped into chunks, null tiles/chunks are transparent
+struct EGATileGrid {
+   u32 tilesX = 0, tilesY = 0;
+   u32 chunksX = 0, chunksY = 0;
+   std::atomic<byte**> *chunks = nullptr;
+};
+
 
 
 struct EGATexture {
    u32 w = 0, h = 0;
-   u32 pixelCount = 0; //convenience
+   u64 pixelCount = 0; //convenience
    EGARegion fullRegion = { 0 };
 
-   byte *pixelData = nullptr;
+   byte *pixelData = nullptr; // linear textures
+
+   bool tiled = false;
+   EGATileGrid grid;
 
    ColorRGBA *decodePixels = nullptr;
    EGAPalette lastDecodedPalette = { 0 };
+   Texture *lastDecodeTarget = nullptr;
+
+   // which palette indices show up in each row and each EGA_INDEX_COLUMN wide column
+   // kept up (as a superset) by decode so a palette change only re-decodes where the changed slots are used
+   bool indexMapValid = false;
+   std::vector<u16> rowIndices, columnIndices;
 
    TexCleanFlag dirty = Tex_ALL_DIRTY;
+
+   // areas changed since last decode, only used while dirty isnt set
+   Recti dirtyRects[EGA_MAX_DIRTY_RECTS];
+   u32 dirtyRectCount = 0;
+
+   // compiled opaque runs, spanRows[y] to spanRows[y+1] are row y's spans
+   bool compiled = false;
+   std::vector<u32> spanRows;
+   std::vector<EGASpan> spans;
 };
 
+static void _textureMarkAllDirty(EGATexture *self) {
+   self->dirty = Tex_ALL_DIRTY;
+   self->dirtyRectCount = 0;
+}
+
+static bool _rectContains(Recti const &outer, Recti const &inner) {
+   return inner.x >= outer.x && inner.y >= outer.y &&
+      inner.x + inner.w <= outer.x + outer.w &&
+      inner.y + inner.h <= outer.y + outer.h;
+}
+
+static Recti _rectUnion(Recti const &a, Recti const &b) {
+   i32 x = MIN(a.x, b.x), y = MIN(a.y, b.y);
+   i32 right = MAX(a.x + a.w, b.x + b.w), bottom = MAX(a.y + a.h, b.y + b.h);
+   return { x, y, right - x, bottom - y };
+}
+
+// r is in texture coords, gets clipped to the texture
+static void _textureMarkDirty(EGATexture *self, Recti r) {
+   self->dirty |= Tex_SPANS_DIRTY;
+
+   if (self->dirty & Tex_DECODE_DIRTY) {
+      return; // already doing everything
+   }
+
+   i32 right = MIN(r.x + r.w, (i32)self->w), bottom = MIN(r.y + r.h, (i32)self->h);
+   r.x = MAX(r.x, 0);
+   r.y = MAX(r.y, 0);
+   r.w = right - r.x;
+   r.h = bottom - r.y;
+   if (r.w <= 0 || r.h <= 0) {
+      return;
+   }
+
+   auto rects = self->dirtyRects;
+   auto &count = self->dirtyRectCount;
+
+   for (u32 i = 0; i < count; ++i) {
+      if (_rectContains(rects[i], r)) {
+         return;
+      }
+   }
+
+   if (count == EGA_MAX_DIRTY_RECTS) {
+      // full up, fold it into whichever rect grows the least
+      u32 best = 0;
+      i64 bestGrowth = INT64_MAX;
+      for (u32 i = 0; i < count; ++i) {
+         auto u = _rectUnion(rects[i], r);
+         i64 growth = (i64)u.w * u.h - (i64)rects[i].w * rects[i].h;
+         if (growth < bestGrowth) {
+            bestGrowth = growth;
+            best = i;
+         }
+      }
+      r = _rectUnion(rects[best], r);
+      rects[best] = rects[--count];
+   }
+
+   // anything the new rect swallows can go
+   for (u32 i = 0; i < count;) {
+      if (_rectContains(r, rects[i])) {
+         rects[i] = rects[--count];
+      }
+      else {
+         ++i;
+      }
+   }
+
+   if ((u32)r.w == self->w && (u32)r.h == self->h) {
+      _textureMarkAllDirty(self);
+      return;
+   }
+
+   rects[count++] = r;
+}
+
+#pragma region TILES
+
+/*
+Tiled textures keep pixels in fixed square tiles instead of one w*h array
+A tile only gets allocated once something other than EGA_ALPHA is written to it and the parts of
+edge tiles hanging past w/h stay EGA_ALPHA
+Tile pointers live in chunks of EGA_CHUNK_SIZE square tiles that are also allocated on demand so an
+empty texture is just the chunk directory, chunks get published atomically so command list bands can share them
+
+Anything touching pixels of a texture that might be tiled goes through the _tex helpers, they hand out row pieces
+that stay inside one tile (linear textures just get the rest of the row) so the callers loop over pieces
+*/
+
+#define EGA_TILE_MASK (EGA_TILE_SIZE - 1)
+#define EGA_TILE_PIXELS (EGA_TILE_SIZE * EGA_TILE_SIZE)
+#define EGA_CHUNK_SHIFT 6
+#define EGA_CHUNK_SIZE (1 << EGA_CHUNK_SHIFT)
+#define EGA_CHUNK_MASK (EGA_CHUNK_SIZE - 1)
+#define EGA_CHUNK_TILES (EGA_CHUNK_SIZE * EGA_CHUNK_SIZE)
+
+// what a missing tile reads as
+static byte const *_emptyTileRow() {
+   static byte row[EGA_TILE_SIZE];
+   static bool init = (memset(row, EGA_ALPHA, sizeof(row)), true);
+   (void)init;
+   return row;
+}
+
+static byte *_tileAlloc() {
+   auto tile = new byte[EGA_TILE_PIXELS];
+   memset(tile, EGA_ALPHA, EGA_TILE_PIXELS);
+   return tile;
+}
+
+static void _gridInit(EGATileGrid &g, u32 width, u32 height) {
+   g.tilesX = (width + EGA_TILE_MASK) >> EGA_TILE_SHIFT;
+   g.tilesY = (height + EGA_TILE_MASK) >> EGA_TILE_SHIFT;
+   g.chunksX = (g.tilesX + EGA_CHUNK_MASK) >> EGA_CHUNK_SHIFT;
+   g.chunksY = (g.tilesY + EGA_CHUNK_MASK) >> EGA_CHUNK_SHIFT;
+
+   u64 count = (u64)g.chunksX * g.chunksY;
+   g.chunks = new std::atomic<byte**>[count];
+   for (u64 i = 0; i < count; ++i) {
+      g.chunks[i] = nullptr;
+   }
+}
+
+static std::atomic<byte**> &_gridChunk(EGATileGrid const &g, u32 tx, u32 ty) {
+   return g.chunks[(u64)(ty >> EGA_CHUNK_SHIFT) * g.chunksX + (tx >> EGA_CHUNK_SHIFT)];
+}
+
+static byte *_gridGet(EGATileGrid const &g, u32 tx, u32 ty) {
+   byte **chunk = _gridChunk(g, tx, ty).load(std::memory_order_acquire);
+   return chunk ? chunk[((ty & EGA_CHUNK_MASK) << EGA_CHUNK_SHIFT) + (tx & EGA_CHUNK_MASK)] : nullptr;
+}
+
+// the tile pointer itself, allocating its chunk if needed
+static byte *&_gridSlot(EGATileGrid &g, u32 tx, u32 ty) {
+   auto &entry = _gridChunk(g, tx, ty);
+   byte **chunk = entry.load(std::memory_order_acquire);
+   if (!chunk) {
+      byte **fresh = new byte*[EGA_CHUNK_TILES]();
+      if (entry.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)) {
+         chunk = fresh;
+      }
+      else {
+         delete[] fresh; // somebody else got there first, chunk is theirs now
+      }
+   }
+   return chunk[((ty & EGA_CHUNK_MASK) << EGA_CHUNK_SHIFT) + (tx & EGA_CHUNK_MASK)];
+}
+
+// fn(byte *&tile, tx, ty) for every allocated tile
+template<typename Fn>
+static void _gridEach(EGATileGrid const &g, Fn &&fn) {
+   for (u32 cy = 0; cy < g.chunksY; ++cy) {
+      for (u32 cx = 0; cx < g.chunksX; ++cx) {
+         byte **chunk = g.chunks[(u64)cy * g.chunksX + cx].load(std::memory_order_relaxed);
+         if (!chunk) {
+            continue;
+         }
+
+         for (u32 i = 0; i < EGA_CHUNK_TILES; ++i) {
+            if (chunk[i]) {
+               fn(chunk[i], (cx << EGA_CHUNK_SHIFT) + (i & EGA_CHUNK_MASK), (cy << EGA_CHUNK_SHIFT) + (i >> EGA_CHUNK_SHIFT));
+            }
+         }
+      }
+   }
+}
+
+// frees the directory and chunks, tiles have to be dealt with already
+static void _gridFreeChunks(EGATileGrid &g) {
+   u64 count = (u64)g.chunksX * g.chunksY;
+   for (u64 i = 0; i < count; ++i) {
+      delete[] g.chunks[i].load(std::memory_order_relaxed);
+   }
+   delete[] g.chunks;
+   g = EGATileGrid();
+}
+
+static void _gridFree(EGATileGrid &g) {
+   _gridEach(g, [](byte *&tile, u32, u32) { delete[] tile; });
+   _gridFreeChunks(g);
+}
+
+// how many pixels from x on are contiguous in memory
+static u32 _texRun(EGATexture const *self, u32 x) {
+   return self->tiled ? MIN((u32)EGA_TILE_SIZE - (x & EGA_TILE_MASK), self->w - x) : self->w - x;
+}
+
+static byte const *_texReadPtr(EGATexture const *self, u32 x, u32 y) {
+   if (!self->tiled) {
+      return self->pixelData + (u64)y * self->w + x;
+   }
+
+   byte const *tile = _gridGet(self->grid, x >> EGA_TILE_SHIFT, y >> EGA_TILE_SHIFT);
+   if (!tile) {
+      return _emptyTileRow() + (x & EGA_TILE_MASK);
+   }
+   return tile + ((y & EGA_TILE_MASK) << EGA_TILE_SHIFT) + (x & EGA_TILE_MASK);
+}
+
+// allocates the tile if its missing
+static byte *_texWritePtr(EGATexture *self, u32 x, u32 y) {
+   if (!self->tiled) {
+      return self->pixelData + (u64)y * self->w + x;
+   }
+
+   auto &tile = _gridSlot(self->grid, x >> EGA_TILE_SHIFT, y >> EGA_TILE_SHIFT);
+   if (!tile) {
+      tile = _tileAlloc();
+   }
+   return tile + ((y & EGA_TILE_MASK) << EGA_TILE_SHIFT) + (x & EGA_TILE_MASK);
+}
+
+// false for a missing tile, so writing EGA_ALPHA there can be skipped
+static bool _texHasPixels(EGATexture const *self, u32 x, u32 y) {
+   return !self->tiled || _gridGet(self->grid, x >> EGA_TILE_SHIFT, y >> EGA_TILE_SHIFT);
+}
+
+static void _texSetPixel(EGATexture *self, u32 x, u32 y, byte color) {
+   if (color != EGA_ALPHA || _texHasPixels(self, x, y)) {
+      *_texWritePtr(self, x, y) = color;
+   }
+}
+
+static void _texFill(EGATexture *self, u32 x, u32 y, u32 len, byte color) {
+   if (!self->tiled) {
+      memset(self->pixelData + (u64)y * self->w + x, color, len);
+      return;
+   }
+
+   while (len) {
+      u32 run = MIN(len, _texRun(self, x));
+      if (color != EGA_ALPHA || _texHasPixels(self, x, y)) {
+         memset(_texWritePtr(self, x, y), color, run);
+      }
+      x += run; len -= run;
+   }
+}
+
+static void _texReadRow(EGATexture const *self, u32 x, u32 y, u32 len, byte *out) {
+   while (len) {
+      u32 run = MIN(len, _texRun(self, x));
+      memcpy(out, _texReadPtr(self, x, y), run);
+      out += run; x += run; len -= run;
+   }
+}
+
+static void _texWriteRow(EGATexture *self, u32 x, u32 y, u32 len, byte const *in) {
+   while (len) {
+      u32 run = MIN(len, _texRun(self, x));
+
+      bool write = _texHasPixels(self, x, y);
+      for (u32 i = 0; i < run && !write; ++i) {
+         write = in[i] != EGA_ALPHA;
+      }
+      if (write) {
+         memcpy(_texWritePtr(self, x, y), in, run);
+      }
+
+      in += run; x += run; len -= run;
+   }
+}
+
+// only writes the opaque (palette index) bytes of in
+static void _texBlendRow(EGATexture *self, u32 x, u32 y, u32 len, byte const *in) {
+   while (len) {
+      u32 run = MIN(len, _texRun(self, x));
+
+      u32 first = 0;
+      while (first < run && in[first] >= EGA_PALETTE_COLORS) { ++first; }
+      if (first < run) {
+         byte *dest = _texWritePtr(self, x, y);
+         for (u32 i = first; i < run; ++i) {
+            if (in[i] < EGA_PALETTE_COLORS) {
+               dest[i] = in[i];
+            }
+         }
+      }
+
+      in += run; x += run; len -= run;
+   }
+}
+
+// fills every pixel inside w/h, EGA_ALPHA just drops the tiles
+static void _tiledFill(EGATexture *self, byte color) {
+   auto &g = self->grid;
+   if (color == EGA_ALPHA) {
+      u32 w = self->w, h = self->h;
+      _gridFree(g);
+      _gridInit(g, w, h);
+      return;
+   }
+
+   for (u32 ty = 0; ty < g.tilesY; ++ty) {
+      for (u32 tx = 0; tx < g.tilesX; ++tx) {
+         auto &tile = _gridSlot(g, tx, ty);
+         if (!tile) {
+            tile = _tileAlloc();
+         }
+
+         u32 tw = MIN((u32)EGA_TILE_SIZE, self->w - (tx << EGA_TILE_SHIFT));
+         u32 th = MIN((u32)EGA_TILE_SIZE, self->h - (ty << EGA_TILE_SHIFT));
+         for (u32 y = 0; y < th; ++y) {
+            memset(tile + (y << EGA_TILE_SHIFT), color, tw);
+         }
+      }
+   }
+}
+
+static void _tiledResize(EGATexture *self, u32 width, u32 height) {
+   EGATileGrid resized;
+   _gridInit(resized, width, height);
+
+   _gridEach(self->grid, [&](byte *&tile, u32 tx, u32 ty) {
+      if (tx >= resized.tilesX || ty >= resized.tilesY) {
+         delete[] tile;
+         return;
+      }
+
+      // whatever got cut off has to read as transparent if it grows back
+      u32 keepW = MIN((u32)EGA_TILE_SIZE, width - (tx << EGA_TILE_SHIFT));
+      u32 keepH = MIN((u32)EGA_TILE_SIZE, height - (ty << EGA_TILE_SHIFT));
+      for (u32 y = 0; y < EGA_TILE_SIZE; ++y) {
+         if (y >= keepH) {
+            memset(tile + (y << EGA_TILE_SHIFT), EGA_ALPHA, EGA_TILE_SIZE);
+         }
+         else if (keepW < EGA_TILE_SIZE) {
+            memset(tile + (y << EGA_TILE_SHIFT) + keepW, EGA_ALPHA, EGA_TILE_SIZE - keepW);
+         }
+      }
+
+      _gridSlot(resized, tx, ty) = tile;
+   });
+
+   _gridFreeChunks(self->grid);
+   self->grid = resized;
+}
+
+#pragma endregion
+
 static void _freeTextureBuffers(EGATexture *self) {
    if (self->decodePixels) {
       delete[] self->decodePixels;
@@ -83,6 +720,13 @@ static void _freeTextureBuffers(EGATexture *self) {
       delete[] self->pixelData;
       self->pixelData = nullptr;
    }
+
+   if (self->grid.chunks) {
+      _gridFree(self->grid);
+   }
+
+   self->spanRows.clear();
+   self->spans.clear();
 }
 
 EGATexture *egaTextureCreate(u32 width, u32 height) {
@@ -92,7 +736,25 @@ EGATexture *egaTextureCreate(u32 width, u32 height) {
 
    return self;
 }
+EGATexture *egaTextureCreateTiled(u32 width, u32 height) {
+   EGATexture *self = new EGATexture();
+   self->tiled = true;
+
+   egaTextureResize(self, width, height);
+
+   return self;
+}
 EGATexture *egaTextureCreateCopy(EGATexture const *other) {
+   if (other->tiled) {
+      auto out = egaTextureCreateTiled(other->w, other->h);
+      _gridEach(other->grid, [&](byte *&tile, u32 tx, u32 ty) {
+         auto copy = new byte[EGA_TILE_PIXELS];
+         memcpy(copy, tile, EGA_TILE_PIXELS);
+         _gridSlot(out->grid, tx, ty) = copy;
+      });
+      return out;
+   }
+
    auto out = egaTextureCreate(other->w, other->h);
    memcpy(out->pixelData, other->pixelData, out->pixelCount);
    return out;
@@ -102,33 +764,42 @@ void egaTextureDestroy(EGATexture *self) {
    delete self;
 }
 
-#pragma region OLD ENCODING CODE
+static void _compileSpans(EGATexture *self) {
+   self->spans.clear();
+   self->spanRows.resize(self->h + 1);
 
-struct PaletteColor;
+   byte *row = self->pixelData;
+   for (u32 y = 0; y < self->h; ++y) {
+      self->spanRows[y] = (u32)self->spans.size();
 
-struct PaletteEntry {
-   PaletteEntry *next, *prev;
-   float distance;
-   PaletteColor* color;
-};
+      u32 x = 0;
+      while (x < self->w) {
+         while (x < self->w && row[x] >= EGA_PALETTE_COLORS) { ++x; }
+         u32 start = x;
+         while (x < self->w && row[x] < EGA_PALETTE_COLORS) { ++x; }
 
-typedef PaletteEntry* pPaletteEntry;
-
-struct PaletteColor {
-   byte removable;
-   byte pPos;
-   byte EGAColor;
-   float distance;
-   PaletteEntry entries[64];
-   PaletteColor() :removable(1) {}
-   PaletteColor(byte c) :EGAColor(c), removable(1) {}
-   PaletteColor(byte c, byte targetPalettPosition) :EGAColor(c), removable(0), pPos(targetPalettPosition) {}
-};
+         if (x > start) {
+            self->spans.push_back({ start, x - start });
+         }
+      }
 
-struct ImageColor {
-   pPaletteEntry closestColor;
-   ImageColor() :closestColor(0) {}
-};
+      row += self->w;
+   }
+
+   self->spanRows[self->h] = (u32)self->spans.size();
+   self->dirty &= ~Tex_SPANS_DIRTY;
+}
+
+void egaTextureCompile(EGATexture *self) {
+   if (self->tiled) {
+      return;
+   }
+
+   self->compiled = true;
+   _compileSpans(self);
+}
+
+#pragma region OLD ENCODING CODE
 
 float GCRGB(byte component) {
    static float GCRGBTable[256] = { 0.0f };
@@ -213,75 +884,176 @@ ColorRGBA EGAColorLookup(byte c) {
    return r;
 }
 
-void insertSortedPaletteEntry(ImageColor &color, PaletteColor &parent, byte target, byte current, PaletteEntry &out) {
-
-   out.color = &parent;
-   out.distance = sqrt(colorDistance(EGAColorLookup(target), EGAColorLookup(current)));
+// distances between every pair of the 64 EGA colors, same metric the encoder has always used
+struct EGADistanceMatrix {
+   f32 d[EGA_COLORS][EGA_COLORS];
+};
 
-   auto iter = color.closestColor;
-   if (!iter) {
-      out.next = out.prev = nullptr;
-      color.closestColor = &out;
-   }
-   else {
-      PaletteEntry *prev = nullptr;
-      while (iter && out.distance > iter->distance) {
-         prev = iter;
-         iter = iter->next;
+static EGADistanceMatrix const &_egaDistances() {
+   static EGADistanceMatrix const matrix = [] {
+      EGADistanceMatrix out;
+      for (u32 a = 0; a < EGA_COLORS; ++a) {
+         for (u32 b = 0; b < EGA_COLORS; ++b) {
+            out.d[a][b] = sqrt(colorDistance(EGAColorLookup(a), EGAColorLookup(b)));
+         }
       }
+      return out;
+   }();
+   return matrix;
+}
 
-      if (!prev) {
-         out.prev = nullptr;
-         out.next = color.closestColor;
-         out.next->prev = &out;
-         color.closestColor = &out;
-      }
-      else {
-         out.next = iter;
-         out.prev = prev;
-         if (out.next) {
-            out.next->prev = &out;
-         }
+// Palette reduction
+// starts with all 64 EGA colors and keeps dropping the one that costs the least until what's left fits the target palette
+// a color's cost is how many pixels are that exact color times how far they'd have to move to the nearest survivor,
+// so only colors whose nearest survivor just got removed need their cost redone
+struct EGAPaletteReduction {
+   bool alive[EGA_COLORS];
+   bool removable[EGA_COLORS];   // false for colors the target palette forces
+   byte slot[EGA_COLORS];        // forced colors' position in the target palette
+   byte nearest[EGA_COLORS];     // closest other survivor, EGA_COLORS if there isn't one
+   f32 cost[EGA_COLORS];
+   u32 aliveCount;
+};
 
-         out.prev->next = &out;
+static void _reductionUpdate(EGAPaletteReduction &r, u32 const counts[EGA_COLORS], u32 c) {
+   auto &d = _egaDistances().d[c];
+
+   byte nearest = EGA_COLORS;
+   for (u32 other = 0; other < EGA_COLORS; ++other) {
+      if (other != c && r.alive[other] && (nearest == EGA_COLORS || d[other] < d[nearest])) {
+         nearest = (byte)other;
       }
    }
-}
 
-bool isClosest(ImageColor &color, PaletteEntry &entry) {
-   return color.closestColor == &entry;
+   r.nearest[c] = nearest;
+
+   // the last color standing can't go anywhere
+   r.cost[c] = nearest == EGA_COLORS ? FLT_MAX : counts[c] * (d[nearest] - d[c]);
 }
 
-void removeColorEntries(PaletteColor *removedColor, ImageColor *colors) {
-   for (auto& entry : removedColor->entries) {
-      for (auto color = colors; color != colors + 64; ++color) {
-         if (color->closestColor == &entry) {
-            color->closestColor = entry.next;
-         }
+static void _reductionRemove(EGAPaletteReduction &r, u32 const counts[EGA_COLORS], u32 c) {
+   r.alive[c] = false;
+   --r.aliveCount;
+
+   for (u32 other = 0; other < EGA_COLORS; ++other) {
+      if (r.alive[other] && r.nearest[other] == c) {
+         _reductionUpdate(r, counts, other);
       }
-      if (entry.prev) entry.prev->next = entry.next;
-      if (entry.next) entry.next->prev = entry.prev;
    }
 }
 
-struct rgbega {
-   int rgb;
-   byte ega;
-   rgbega() {}
-   rgbega(int _rgb, byte _ega) :rgb(_rgb), ega(_ega) {}
-   bool operator<(int other) {
-      return rgb < other;
-   }
-};
+// counts is how many opaque pixels landed on each EGA color
+// fills resultPalette and lut, which takes each of the 64 EGA colors to its index in resultPalette
+// returns false if the target palette has no usable entries
+static bool _reducePalette(u32 const counts[EGA_COLORS], EGAPalette const *targetPalette, EGAPalette *resultPalette, byte lut[EGA_COLORS]) {
+   auto p = targetPalette->colors;
 
-byte closestEGA(int rgb) {
-   float lowest = 1000.0;
-   int closest = 0;
+   EGAPaletteReduction r;
+   memset(r.removable, 1, sizeof(r.removable));
+   memset(r.alive, 1, sizeof(r.alive));
+   r.aliveCount = EGA_COLORS;
 
-   for (byte i = 0; i < 64; ++i) {
-      auto c = EGAColorLookup(i);
+   u32 totalCount = 0;
+   for (u32 i = 0; i < EGA_PALETTE_COLORS; ++i) {
+      if (p[i] != EGA_COLOR_UNUSED) {
+         if (p[i] != EGA_COLOR_UNDEFINED) {
+            r.removable[p[i]] = false;
+            r.slot[p[i]] = (byte)totalCount;
+         }
 
-      float diff = colorDistance(*(ColorRGBA*)&rgb, c);
+         ++totalCount;
+      }
+   }
+
+   if (!totalCount) {
+      return false;
+   }
+
+   for (u32 c = 0; c < EGA_COLORS; ++c) {
+      _reductionUpdate(r, counts, c);
+   }
+
+   //worst color, worst error...
+   while (r.aliveCount > totalCount) {
+      f32 lowest = FLT_MAX;
+      u32 rarest = EGA_COLORS;
+      for (u32 c = 0; c < EGA_COLORS; ++c) {
+         if (r.alive[c] && r.removable[c] && r.cost[c] < lowest) {
+            lowest = r.cost[c];
+            rarest = c;
+         }
+      }
+
+      if (rarest == EGA_COLORS) {
+         break;
+      }
+      _reductionRemove(r, counts, rarest);
+   }
+
+   //eliminate unused colors
+   // survivors keep the cost they had when they got checked here, that's what orders the palette
+   byte order[EGA_COLORS];
+   f32 orderCost[EGA_COLORS];
+   u32 orderCount = 0;
+   for (u32 c = 0; c < EGA_COLORS; ++c) {
+      if (r.alive[c] && r.removable[c]) {
+         if (r.cost[c] == 0.0f) {
+            _reductionRemove(r, counts, c);
+         }
+         else {
+            orderCost[c] = r.cost[c];
+            order[orderCount++] = (byte)c;
+         }
+      }
+   }
+
+   // the colors that would hurt most to lose get the low palette entries
+   std::stable_sort(order, order + orderCount, [&](byte a, byte b) { return orderCost[a] > orderCost[b]; });
+
+   //two passes, first to insert colors who have locked positions in the palette
+   byte paletteOut[EGA_PALETTE_COLORS];
+   byte colorSlot[EGA_COLORS];
+   memset(paletteOut, EGA_COLOR_UNUSED, sizeof(paletteOut));
+
+   for (u32 c = 0; c < EGA_COLORS; ++c) {
+      if (r.alive[c] && !r.removable[c]) {
+         paletteOut[r.slot[c]] = (byte)c;
+         colorSlot[c] = r.slot[c];
+      }
+   }
+
+   //next is to fill in the blanks with the rest
+   u32 next = 0;
+   for (u32 i = 0; i < orderCount; ++i) {
+      while (paletteOut[next] != EGA_COLOR_UNUSED) { ++next; }
+      paletteOut[next] = order[i];
+      colorSlot[order[i]] = (byte)next++;
+   }
+
+   // every EGA color goes to its closest survivor, ties go to the higher color
+   auto &d = _egaDistances().d;
+   for (u32 c = 0; c < EGA_COLORS; ++c) {
+      u32 closest = EGA_COLORS;
+      for (u32 s = 0; s < EGA_COLORS; ++s) {
+         if (r.alive[s] && (closest == EGA_COLORS || d[c][s] <= d[c][closest])) {
+            closest = s;
+         }
+      }
+      lut[c] = colorSlot[closest];
+   }
+
+   memcpy(resultPalette->colors, paletteOut, sizeof(paletteOut));
+   return true;
+}
+
+byte closestEGA(int rgb) {
+   float lowest = 1000.0;
+   int closest = 0;
+
+   for (byte i = 0; i < 64; ++i) {
+      auto c = EGAColorLookup(i);
+
+      float diff = colorDistance(*(ColorRGBA*)&rgb, c);
 
       if (diff < lowest) {
          lowest = diff;
@@ -294,194 +1066,285 @@ byte closestEGA(int rgb) {
 
 #pragma endregion
 
-EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targetPalette, EGAPalette *resultPalette) {
-   int colorCounts[64];
-
-   auto texSize = textureGetSize(source);
-
-   auto pixelCount = texSize.x * texSize.y;
-   byte* alpha = new byte[pixelCount];
-   byte* pixelMap = new byte[pixelCount];
-   std::vector<int> cArray(pixelCount);
+#pragma region RGB TO EGA
 
-   memset(resultPalette->colors, 0, 16);
-   memset(colorCounts, 0, sizeof(int) * 64);
-   memset(alpha, 0, pixelCount);
-   memset(pixelMap, 0, pixelCount);
+// closestEGA for every 24-bit color, filled in as colors turn up and kept around for the life of the program
+// entries are the EGA color + 1 so zero means not looked up yet, calloc'd so pages nobody touches never get committed
+// threads can race on an entry but they'd both write the same thing
+static_assert(sizeof(std::atomic<byte>) == 1, "rgb cache needs byte-sized atomics");
 
-   auto texColors = textureGetPixels(source);
+static std::atomic<byte> *_rgbCache() {
+   static auto table = (std::atomic<byte>*)calloc(1 << 24, 1);
+   return table;
+}
 
-   //push every pixel into a vector
-   for (int i = 0; i < texSize.x * texSize.y; ++i) {
-      alpha[i] = texColors[i].a == 255;
-      cArray[i] = *(int*)&texColors[i];
-   }
+// closestEGA with the EGA side of colorDistance done up front, same math in the same order so it picks the same color
+static byte _rgbCacheMiss(ColorRGBA c) {
+   static struct EGAGamma {
+      f32 r[EGA_COLORS], g[EGA_COLORS], b[EGA_COLORS];
+   } const gamma = [] {
+      EGAGamma out;
+      for (u32 i = 0; i < EGA_COLORS; ++i) {
+         auto e = EGAColorLookup(i);
+         out.r[i] = GCRGB(e.r);
+         out.g[i] = GCRGB(e.g);
+         out.b[i] = GCRGB(e.b);
+      }
+      return out;
+   }();
 
-   //sort and unique
-   std::sort(begin(cArray), end(cArray));
-   cArray.erase(std::unique(cArray.begin(), cArray.end()), cArray.end());
+   f32 cr = GCRGB(c.r), cg = GCRGB(c.g), cb = GCRGB(c.b);
 
-   //map the unique colors to their ega equivalents
-   std::vector<rgbega> colorMap(cArray.size());
+   float lowest = 1000.0;
+   byte closest = 0;
+   for (u32 i = 0; i < EGA_COLORS; ++i) {
+      float r = cr - gamma.r[i];
+      float g = cg - gamma.g[i];
+      float b = cb - gamma.b[i];
+      float diff = r * r + g * g + b * b;
 
-   for (unsigned int i = 0; i < cArray.size(); ++i)
-      colorMap[i] = rgbega(cArray[i], closestEGA(cArray[i]));
+      if (diff < lowest) {
+         lowest = diff;
+         closest = (byte)i;
+      }
+   }
 
-   //go throuygh the image and log how often each EGA color appears
-   for (int i = 0; i < pixelCount; ++i) {
-      int c = *(int*)&texColors[i];
+   return closest;
+}
 
-      if (texColors[i].a != 255) {
-         pixelMap[i] = 0;
+// maps a row to the closest of all 64 EGA colors, EGA_ALPHA for anything not fully opaque, and counts them up
+// neighboring pixels are usually the same color so the last lookup gets reused
+static void _rgbToEGARow(ColorRGBA const *src, byte *dst, u32 count, u32 counts[EGA_COLORS]) {
+   auto cache = _rgbCache();
+
+   u32 lastKey = ~0u;
+   byte last = 0;
+   for (u32 i = 0; i < count; ++i) {
+      auto c = src[i];
+      if (c.a != 255) {
+         dst[i] = EGA_ALPHA;
          continue;
       }
 
-      byte ega = std::lower_bound(begin(colorMap), end(colorMap), c)->ega;
+      u32 key = c.r | (c.g << 8) | (c.b << 16);
+      if (key != lastKey) {
+         byte entry = cache[key].load(std::memory_order_relaxed);
+         if (!entry) {
+            entry = _rgbCacheMiss(c) + 1;
+            cache[key].store(entry, std::memory_order_relaxed);
+         }
+
+         last = entry - 1;
+         lastKey = key;
+      }
 
-      pixelMap[i] = ega;
-      colorCounts[ega]++;
+      dst[i] = last;
+      ++counts[last];
    }
+}
 
+// big imports get split into a band of rows per thread, fn(band, top, bottom)
+// rows don't have to be pixel rows, anything that splits up evenly works
+#define EGA_ENCODE_BAND_PIXELS (256 * 1024)
 
-   auto p = targetPalette->colors;
+// per calling thread so a tool running its own pool can keep each encode on one thread
+static thread_local u32 g_encodeThreads = 0;
 
-   byte forced[64];
-   memset(forced, EGA_COLOR_UNUSED, 64);
+void egaSetEncodeThreads(u32 threads) {
+   g_encodeThreads = threads;
+}
 
-   byte totalCount = 0;
-   for (int i = 0; i < 16; ++i) {
-      if (p[i] != EGA_COLOR_UNUSED) {
-         if (p[i] != EGA_COLOR_UNDEFINED) {
-            forced[p[i]] = totalCount;
-         }
+static u32 _encodeBandCount(Int2 size) {
+   u64 pixels = (u64)size.x * size.y;
+   u32 threads = g_encodeThreads ? g_encodeThreads : MAX(1u, std::thread::hardware_concurrency());
+   u64 bands = MIN((u64)threads, pixels / EGA_ENCODE_BAND_PIXELS);
+   return (u32)MAX(1ull, MIN(bands, (u64)size.y));
+}
 
-         ++totalCount;
-      }
+template<typename Fn>
+static void _encodeBands(u32 rows, u32 bandCount, Fn &&fn) {
+   u32 bandHeight = (rows + bandCount - 1) / bandCount;
+   auto run = [&](u32 band) {
+      u32 top = band * bandHeight;
+      fn(band, top, MIN(top + bandHeight, rows));
+   };
+
+   std::vector<std::thread> helpers;
+   for (u32 band = 1; band < bandCount; ++band) {
+      helpers.emplace_back(run, band);
    }
+   run(0);
 
-   if (!totalCount) {
-      return nullptr;
+   for (auto &t : helpers) {
+      t.join();
    }
+}
 
-   std::list<PaletteColor> palette;
-   ImageColor colors[64];
-   for (int i = 0; i < 64; ++i)
-   {
-      if (forced[i] != EGA_COLOR_UNUSED) {
-         palette.push_back(PaletteColor(i, forced[i]));
-      }
-      else {
-         palette.push_back(PaletteColor(i));
+#pragma endregion
+
+// the encode is two passes over bands of rows so nothing but the output is ever full size
+// first pass counts up how many pixels land on each of the 64 EGA colors, second pass maps again
+// (all cache hits by then) and writes each row straight into the output through the reduced palette
+void egaTextureEncodeHistogram(Texture *source, u32 counts[EGA_COLORS]) {
+   auto texSize = textureGetSize(source);
+   auto texColors = textureGetPixels(source);
+
+   u32 bandCount = _encodeBandCount(texSize);
+   std::vector<u32> bandCounts((u64)bandCount * EGA_COLORS);
+
+   _encodeBands(texSize.y, bandCount, [&](u32 band, u32 top, u32 bottom) {
+      auto totals = bandCounts.data() + (u64)band * EGA_COLORS;
+      std::vector<byte> row(texSize.x);
+
+      for (u32 y = top; y < bottom; ++y) {
+         _rgbToEGARow(texColors + (u64)y * texSize.x, row.data(), texSize.x, totals);
       }
+   });
 
-      for (int j = 0; j < 64; ++j)
-      {
-         insertSortedPaletteEntry(colors[j], palette.back(), j, i, palette.back().entries[j]);
+   for (u32 band = 0; band < bandCount; ++band) {
+      for (u32 c = 0; c < EGA_COLORS; ++c) {
+         counts[c] += bandCounts[(u64)band * EGA_COLORS + c];
       }
    }
+}
 
-   while (palette.size() > totalCount)
-   {
-      //worst color, worst error...
-      float lowestDistance = FLT_MAX;
-      std::list<PaletteColor>::iterator rarestColor;
-
-      for (auto color = palette.begin(); color != palette.end(); ++color) //do this with iterators to erase.
-      {
-         float distance = 0.0f;
-         for (auto& entry : color->entries)
-         {
-            if (isClosest(colors[color->EGAColor], entry))
-            {
-               distance += colorCounts[color->EGAColor] * (entry.next->distance - entry.distance);
-            }
-         }
-         if (distance < lowestDistance && color->removable)
-         {
-            lowestDistance = distance;
-            rarestColor = color;
-         }
-      }
+bool egaPaletteReduce(u32 const counts[EGA_COLORS], EGAPalette *targetPalette, EGAPalette *resultPalette) {
+   byte lut[EGA_COLORS];
+   return _reducePalette(counts, targetPalette, resultPalette, lut);
+}
 
-      //remove rarest color, and all of its palette entries in the colors array....
-      removeColorEntries(&*rarestColor, colors);
-      palette.erase(rarestColor);
+EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targetPalette, EGAPalette *resultPalette) {
+   auto texSize = textureGetSize(source);
+   auto texColors = textureGetPixels(source);
+
+   memset(resultPalette->colors, 0, 16);
+
+   u32 colorCounts[EGA_COLORS] = { 0 };
+   egaTextureEncodeHistogram(source, colorCounts);
+
+   byte colorLUT[EGA_COLORS]; //look-up table from 64 colors down the 16 remaining colors.
+   if (!_reducePalette(colorCounts, targetPalette, resultPalette, colorLUT)) {
+      return nullptr;
    }
 
-   //eliminate unused colors
-   for (auto color = palette.begin(); color != palette.end();) {
-      if (color->removable) {
-         color->distance = 0.0f;
+   byte lut[256];
+   memset(lut, EGA_ALPHA, sizeof(lut));
+   memcpy(lut, colorLUT, sizeof(colorLUT));
 
-         for (auto& entry : color->entries) {
-            if (isClosest(colors[color->EGAColor], entry)) {
-               color->distance += colorCounts[color->EGAColor] * (entry.next->distance - entry.distance);
-            }
+   // the output row doubles as the scratch for the 64 color pass, it's still in cache for the lut
+   auto out = egaTextureCreate(texSize.x, texSize.y);
+   _encodeBands(texSize.y, _encodeBandCount(texSize), [&](u32, u32 top, u32 bottom) {
+      u32 counts[EGA_COLORS] = { 0 };
+      for (u32 y = top; y < bottom; ++y) {
+         u64 offset = (u64)y * texSize.x;
+         auto row = out->pixelData + offset;
+
+         _rgbToEGARow(texColors + offset, row, texSize.x, counts);
+         for (u32 x = 0; x < (u32)texSize.x; ++x) {
+            row[x] = lut[row[x]];
          }
+      }
+   });
+   _textureMarkAllDirty(out);
 
-         if (color->distance == 0.0f) {
-            //color wasnt used
-            removeColorEntries(&*color, colors);
-            color = palette.erase(color);
-            continue;
+   return out;
+}
+
+// decodes count pixels starting at offset into decodePixels
+static void _decodeRows(EGATexture *self, EGADecodeLUT const &lut, u32 offset, u32 count) {
+   g_decodeKernel(self->pixelData + offset, self->decodePixels + offset, count, lut);
+}
+
+static void _decodeRect(EGATexture *self, EGADecodeLUT const &lut, Recti const &r) {
+   if (self->tiled) {
+      for (i32 y = r.y; y < r.y + r.h; ++y) {
+         for (u32 x = r.x, right = r.x + r.w; x < right;) {
+            u32 run = MIN(right - x, _texRun(self, x));
+            g_decodeKernel(_texReadPtr(self, x, y), self->decodePixels + (u64)y * self->w + x, run, lut);
+            x += run;
          }
       }
-      ++color;
+      return;
    }
 
-   palette.sort([&](const PaletteColor&r1, const PaletteColor&r2) {return r1.distance > r2.distance; });
+   if ((u32)r.w == self->w) {
+      _decodeRows(self, lut, r.y * self->w, r.w * r.h); // contiguous
+      return;
+   }
 
+   for (i32 y = r.y; y < r.y + r.h; ++y) {
+      _decodeRows(self, lut, y * self->w + r.x, r.w);
+   }
+}
 
-   //this also gives you the look-up table on output...
-   byte paletteOut[16];
-   memset(paletteOut, EGA_COLOR_UNUSED, 16);
-   int LUTcolor = 0;
+#define EGA_INDEX_COLUMN_SHIFT 6
+#define EGA_INDEX_COLUMN (1 << EGA_INDEX_COLUMN_SHIFT)
+
+// ORs the indices used inside r into the index map
+static void _indexMapAdd(EGATexture *self, Recti const &r) {
+   for (i32 y = r.y; y < r.y + r.h; ++y) {
+      u32 rowMask = 0;
+      for (u32 x = r.x, right = r.x + r.w; x < right;) {
+         // pieces stay inside one column
+         u32 run = MIN(right - x, (u32)EGA_INDEX_COLUMN - (x & (EGA_INDEX_COLUMN - 1)));
+         run = MIN(run, _texRun(self, x));
+
+         byte const *px = _texReadPtr(self, x, y);
+         u32 mask = 0;
+         for (u32 i = 0; i < run; ++i) {
+            mask |= px[i] < EGA_PALETTE_COLORS ? 1u << px[i] : 0;
+         }
 
-   //two passes, first to inster colors who have locked positions in the palette
-   for (auto& color : palette) {
-      if (!color.removable) {
-         paletteOut[color.pPos] = color.EGAColor;
-         color.EGAColor = color.pPos;
+         self->columnIndices[x >> EGA_INDEX_COLUMN_SHIFT] |= mask;
+         rowMask |= mask;
+         x += run;
       }
+      self->rowIndices[y] |= rowMask;
    }
+}
 
-   //next is to fill in the blanks with the rest
-   for (auto& color : palette)
-   {
-      if (color.removable) {
-         while (paletteOut[LUTcolor] != EGA_COLOR_UNUSED) { LUTcolor += 1; };
-         paletteOut[LUTcolor] = color.EGAColor;
-         color.EGAColor = LUTcolor++;
+static void _indexMapRebuild(EGATexture *self) {
+   self->rowIndices.assign(self->h, 0);
+   self->columnIndices.assign((self->w + EGA_INDEX_COLUMN - 1) >> EGA_INDEX_COLUMN_SHIFT, 0);
+   _indexMapAdd(self, self->fullRegion);
+   self->indexMapValid = true;
+}
+
+// covers everywhere the slots are used, runs of rows become one rect
+// and the allowed gap between runs grows until it fits in EGA_MAX_DIRTY_RECTS
+static void _indexMapRects(EGATexture const *self, u16 slots, std::vector<Recti> &out) {
+   i32 left = INT32_MAX, right = INT32_MIN;
+   for (u32 c = 0; c < self->columnIndices.size(); ++c) {
+      if (self->columnIndices[c] & slots) {
+         left = MIN(left, (i32)(c << EGA_INDEX_COLUMN_SHIFT));
+         right = MAX(right, (i32)MIN(self->w, (c + 1) << EGA_INDEX_COLUMN_SHIFT));
       }
    }
 
-   byte colorLUT[64]; //look-up table from 64 colors down the 16 remaining colors.
-   LUTcolor = 0;
-   for (auto& color : colors){
-      colorLUT[LUTcolor++] = color.closestColor->color->EGAColor;
+   out.clear();
+   if (left >= right) {
+      return;
    }
 
-   memcpy(resultPalette->colors, paletteOut, 16);
-
-   auto out = egaTextureCreate(texSize.x, texSize.y);
-   egaClearAlpha(out);
-   for (int i = 0; i < pixelCount; ++i) {
-      
-
-      if (texColors[i].a == 255) {
-         EGAColor c = colorLUT[pixelMap[i]];
+   for (i32 gap = 0;; gap = gap * 2 + 1) {
+      out.clear();
+      for (i32 y = 0; y < (i32)self->h; ++y) {
+         if (!(self->rowIndices[y] & slots)) {
+            continue;
+         }
 
-         auto x = i % texSize.x;
-         auto y = i / texSize.x;
+         if (!out.empty() && y - (out.back().y + out.back().h) <= gap) {
+            out.back().h = y - out.back().y + 1;
+         }
+         else {
+            out.push_back({ left, y, right - left, 1 });
+         }
+      }
 
-         egaRenderPoint(out, { x, y }, c);
+      if (out.size() <= EGA_MAX_DIRTY_RECTS) {
+         return;
       }
    }
-
-   delete[] alpha;
-   delete[] pixelMap;
-
-   return out;
 }
 
 // target must exist and must match ega's size, returns !0 on success
@@ -493,343 +1356,2909 @@ int egaTextureDecode(EGATexture *self, Texture* target, EGAPalette *palette){
    }
 
    if (!self->decodePixels) {
-      self->decodePixels = new ColorRGBA[self->w * self->h];
+      self->decodePixels = new ColorRGBA[(u64)self->w * self->h];
       self->dirty |= Tex_DECODE_DIRTY;
    }
 
    //palette changed!
-   if (memcmp(palette->colors, self->lastDecodedPalette.colors, sizeof(EGAPalette))) {
+   u16 changedSlots = 0;
+   for (u32 i = 0; i < EGA_PALETTE_COLORS; ++i) {
+      if (palette->colors[i] != self->lastDecodedPalette.colors[i]) {
+         changedSlots |= 1 << i;
+      }
+   }
+
+   // if the buffer is otherwise current only the pixels using the changed slots need redoing
+   std::vector<Recti> paletteRects;
+   if (changedSlots) {
       self->lastDecodedPalette = *palette;
-      self->dirty |= Tex_DECODE_DIRTY;
+
+      if (!(self->dirty & Tex_DECODE_DIRTY) && self->indexMapValid && target == self->lastDecodeTarget) {
+         _indexMapRects(self, changedSlots, paletteRects);
+      }
+      else {
+         self->dirty |= Tex_DECODE_DIRTY;
+      }
    }
    
-   if (self->dirty&Tex_DECODE_DIRTY) {
-      memset(self->decodePixels, 0, self->pixelCount * sizeof(ColorRGBA));
+   EGADecodeLUT lut;
+   _buildDecodeLUT(palette, lut);
 
-      for (u32 i = 0; i < self->pixelCount; ++i) {
-         auto c = self->pixelData[i];
-         if (c < EGA_PALETTE_COLORS) {
-            ColorRGB rgb = egaGetColor(palette->colors[c]);
-            self->decodePixels[i] = ColorRGBA{ rgb.r, rgb.g, rgb.b, 255 };
-         }
+   if (self->dirty&Tex_DECODE_DIRTY) {
+      _decodeRect(self, lut, self->fullRegion);
+      _indexMapRebuild(self);
+      textureSetPixels(target, (byte*)self->decodePixels);
+   }
+   else if (target != self->lastDecodeTarget) {
+      // decode buffer is fine but this target hasnt seen it yet
+      for (u32 i = 0; i < self->dirtyRectCount; ++i) {
+         _decodeRect(self, lut, self->dirtyRects[i]);
+         _indexMapAdd(self, self->dirtyRects[i]);
+      }
+      textureSetPixels(target, (byte*)self->decodePixels);
+   }
+   else if (self->dirtyRectCount || !paletteRects.empty()) {
+      for (u32 i = 0; i < self->dirtyRectCount; ++i) {
+         _decodeRect(self, lut, self->dirtyRects[i]);
+         _indexMapAdd(self, self->dirtyRects[i]);
+      }
+      for (auto &r : paletteRects) {
+         _decodeRect(self, lut, r);
       }
-      self->dirty &= ~Tex_DECODE_DIRTY;
+
+      paletteRects.insert(paletteRects.end(), self->dirtyRects, self->dirtyRects + self->dirtyRectCount);
+      textureSetPixelsRegions(target, (byte*)self->decodePixels, paletteRects.data(), (u32)paletteRects.size());
    }
 
-   textureSetPixels(target, (byte*)self->decodePixels);
+   self->dirty &= ~Tex_DECODE_DIRTY;
+   self->dirtyRectCount = 0;
+   self->lastDecodeTarget = target;
    return 1;
 }
 
-int egaTextureSerialize(EGATexture *self, byte **outBuff, u64 *size) {
-   return 0;
+/*
+Scaled decode writes the final image in one pass straight from the index buffer
+each source row becomes an index row at output width (replicated or Scale2x'd), that gets run through the decode kernel
+and then copied down for however many output rows land on the same source row
+Scale2x works on indices so it compares exactly and never has to look at rgb
+*/
+
+Int2 egaScaledSize(Int2 size, EGAScaleMode mode, u32 scale) {
+   scale = MAX(scale, 1u);
+   switch (mode) {
+   case EGAScaleMode_ASPECT: return { size.x * (i32)scale, (size.y * 6 * (i32)scale + 4) / 5 };
+   case EGAScaleMode_SCALE2X: return { size.x * 2 * (i32)scale, size.y * 2 * (i32)scale };
+   default: return { size.x * (i32)scale, size.y * (i32)scale };
+   }
 }
-EGATexture *egaTextureDeserialize(byte *buff, u64 size) {
-   return nullptr;
+
+// anything transparent compares the same
+static void _scaleReadRow(EGATexture const *self, i32 y, byte *out) {
+   y = MAX(0, MIN(y, (i32)self->h - 1));
+   _texReadRow(self, 0, y, self->w, out);
+   for (u32 x = 0; x < self->w; ++x) {
+      out[x] = out[x] < EGA_PALETTE_COLORS ? out[x] : EGA_ALPHA;
+   }
 }
 
-void egaTextureResize(EGATexture *self, u32 width, u32 height) {
-   if (width == self->w && height == self->h) {
+static void _scaleReplicate(byte const *src, u32 count, u32 scale, byte *out) {
+   if (scale == 1) {
+      memcpy(out, src, count);
       return;
    }
 
-   // copy over to new size if you have anything
-   if (self->pixelData) {
-      auto copyWidth = MIN(width, self->w);
-      auto copyHeight = MIN(height, self->h);
-      auto newPixelCount = width * height;
+   for (u32 x = 0; x < count; ++x) {
+      memset(out + x * scale, src[x], scale);
+   }
+}
 
-      auto newPixelData = new byte[newPixelCount];
-      memset(newPixelData, EGA_ALPHA, newPixelCount);
+// the two output rows for the middle row, top and bottom are its neighbors
+static void _scale2xRows(byte const *top, byte const *mid, byte const *bottom, u32 w, byte *out0, byte *out1) {
+   for (u32 x = 0; x < w; ++x) {
+      byte p = mid[x];
+      byte a = top[x], d = bottom[x];
+      byte c = mid[x ? x - 1 : 0], b = mid[x + 1 < w ? x + 1 : x];
+
+      out0[x * 2] = (c == a && c != d && a != b) ? a : p;
+      out0[x * 2 + 1] = (a == b && a != c && b != d) ? b : p;
+      out1[x * 2] = (d == c && d != b && c != a) ? c : p;
+      out1[x * 2 + 1] = (b == d && b != a && d != c) ? d : p;
+   }
+}
 
-      byte *destSL = newPixelData;
-      byte *srcSL = self->pixelData;
-      for (int y = 0; y < copyHeight; ++y) {
-         memcpy(destSL, srcSL, copyWidth);
-         destSL += width;
-         srcSL += self->w;
-      }
+int egaTextureDecodeScaledToBuffer(EGATexture const *self, ColorRGBA *out, EGAPalette const *palette, EGAScaleMode mode, u32 scale) {
+   if (!self->w || !self->h) {
+      return 0;
+   }
 
-      self->w = width;
-      self->h = height;
-      self->pixelCount = newPixelCount;
-      delete[] self->pixelData;
-      self->pixelData = newPixelData;
+   scale = MAX(scale, 1u);
+   auto outSize = egaScaledSize({ (i32)self->w, (i32)self->h }, mode, scale);
+   u32 outW = outSize.x;
 
-      if (self->decodePixels) {
-         delete[] self->decodePixels;
-         self->decodePixels = nullptr;
-      }
-   }
-   else {
-      self->w = width;
-      self->h = height;
-      self->pixelCount = self->w * self->h;
-      self->pixelData = new byte[self->pixelCount];
+   EGADecodeLUT lut;
+   _buildDecodeLUT(palette, lut);
+
+   std::vector<byte> rows[3], wide(outW);
+   for (auto &row : rows) {
+      row.resize(self->w);
    }
-   
-   self->fullRegion = EGARegion{ 0, 0, (i32)self->w, (i32)self->h };   
-   self->dirty = Tex_ALL_DIRTY;
-}
 
-Int2 egaTextureGetSize(EGATexture const *self) { return { (i32)self->w, (i32)self->h }; }
-EGARegion *egaTextureGetFullRegion(EGATexture *self) { return &self->fullRegion; }
+   // writes one decoded output row, any following rows from the same source row just copy it
+   i32 outY = 0;
+   auto emit = [&](byte const *indices, i32 count) {
+      auto dest = out + (u64)outY * outW;
+      g_decodeKernel(indices, dest, outW, lut);
+      for (i32 i = 1; i < count; ++i) {
+         memcpy(dest + (u64)i * outW, dest, outW * sizeof(ColorRGBA));
+      }
+      outY += count;
+   };
+
+   if (mode == EGAScaleMode_SCALE2X) {
+      std::vector<byte> pair[2] = { std::vector<byte>(self->w * 2), std::vector<byte>(self->w * 2) };
+      _scaleReadRow(self, 0, rows[1].data());
+      _scaleReadRow(self, 1, rows[2].data());
+      rows[0] = rows[1];
+
+      for (u32 y = 0; y < self->h; ++y) {
+         _scale2xRows(rows[0].data(), rows[1].data(), rows[2].data(), self->w, pair[0].data(), pair[1].data());
+         for (auto &row : pair) {
+            _scaleReplicate(row.data(), self->w * 2, scale, wide.data());
+            emit(wide.data(), scale);
+         }
 
-EGAPColor egaTextureGetColorAt(EGATexture *self, u32 x, u32 y, EGARegion *vp) {
-   if (!vp) { vp = &self->fullRegion; }
+         std::swap(rows[0], rows[1]);
+         std::swap(rows[1], rows[2]);
+         _scaleReadRow(self, y + 2, rows[2].data());
+      }
+      return 1;
+   }
 
-   if (x >= vp->w || y >= vp->h) {
-      return EGA_COLOR_UNDEFINED;
+   for (u32 y = 0; y < self->h; ++y) {
+      // how many output rows land on this source row
+      i32 rowEnd = outSize.y;
+      if (mode == EGAScaleMode_ASPECT) {
+         // output row o shows source row o*5 / 6*scale, so the first row of each 5 gets the extra copy
+         rowEnd = MIN((i32)(((y + 1) * 6 * scale + 4) / 5), outSize.y);
+      }
+      else {
+         rowEnd = (y + 1) * scale;
+      }
+
+      _scaleReadRow(self, y, rows[0].data());
+      _scaleReplicate(rows[0].data(), self->w, scale, wide.data());
+      emit(wide.data(), rowEnd - outY);
    }
 
-   x += vp->x;
-   y += vp->y;
+   return 1;
+}
 
-   if (x >= self->w || y >= self->h ||
-      x < 0 || y < 0) {
-      return EGA_COLOR_UNDEFINED;
+int egaTextureDecodeScaled(EGATexture const *self, Texture *target, EGAPalette const *palette, EGAScaleMode mode, u32 scale) {
+   auto outSize = egaScaledSize({ (i32)self->w, (i32)self->h }, mode, scale);
+   auto texSize = textureGetSize(target);
+   if (texSize.x != outSize.x || texSize.y != outSize.y) {
+      return 0;
    }
 
-   auto c = self->pixelData[y * self->w + x];
-   if (c < EGA_PALETTE_COLORS) {
-      return c;
+   std::vector<ColorRGBA> decoded((u64)outSize.x * outSize.y);
+   if (!egaTextureDecodeScaledToBuffer(self, decoded.data(), palette, mode, scale)) {
+      return 0;
    }
-   
-   return EGA_COLOR_UNDEFINED;
+
+   textureSetPixels(target, (byte*)decoded.data());
+   return 1;
 }
 
-struct EGAFontFactory {
-   EMPTY_STRUCT;
-};
+#pragma region TILE PALETTES
 
-struct EGAFont {
-   EMPTY_STRUCT;
+// most lloyd passes per new palette, they usually settle in a few
+#define EGA_TILE_PALETTE_ITERATIONS 8
+
+// runs shorter than this decode without the simd kernels
+#define EGA_TILE_PALETTE_KERNEL_RUN 64
+
+struct EGATilePalettes {
+   u32 w = 0, h = 0;
+   u32 tileW = 0, tileH = 0;
+   u32 tilesX = 0, tilesY = 0;
+   std::vector<EGAPalette> palettes;
+   std::vector<byte> map; // palette index per tile, row-major
 };
 
-EGAFontFactory *egaFontFactoryCreate(EGATexture *font) {
-   return nullptr;
+EGATilePalettes *egaTilePalettesCreate(u32 width, u32 height, Int2 tileSize, u32 paletteCount) {
+   auto out = new EGATilePalettes();
+   out->w = width;
+   out->h = height;
+   out->tileW = MAX(tileSize.x, 1);
+   out->tileH = MAX(tileSize.y, 1);
+   out->tilesX = (width + out->tileW - 1) / out->tileW;
+   out->tilesY = (height + out->tileH - 1) / out->tileH;
+
+   out->palettes.resize(MAX(1u, MIN(paletteCount, (u32)EGA_MAX_TILE_PALETTES)));
+   for (auto &p : out->palettes) {
+      memset(p.colors, 0, sizeof(p.colors));
+   }
+   out->map.resize((u64)out->tilesX * out->tilesY);
+   return out;
+}
+void egaTilePalettesDestroy(EGATilePalettes *self) {
+   delete self;
 }
-void egaFontFactoryDestroy(EGAFontFactory *self) {
 
+Int2 egaTilePalettesGetTileSize(EGATilePalettes const *self) {
+   return { (i32)self->tileW, (i32)self->tileH };
 }
-EGAFont *egaFontFactoryGetFont(EGAFontFactory *self, EGAColor bgColor, EGAColor fgColor) {
-   return nullptr;
+Int2 egaTilePalettesGetTileCount(EGATilePalettes const *self) {
+   return { (i32)self->tilesX, (i32)self->tilesY };
 }
-
-void egaClear(EGATexture *target, EGAPColor color, EGARegion *vp) {
-   if (!vp) {
-      //fast clear
-      memset(target->pixelData, color, target->pixelCount);
-      target->dirty = Tex_ALL_DIRTY;
+u32 egaTilePalettesGetPaletteCount(EGATilePalettes const *self) {
+   return (u32)self->palettes.size();
+}
+EGAPalette *egaTilePalettesGetPalette(EGATilePalettes *self, u32 index) {
+   return index < self->palettes.size() ? &self->palettes[index] : nullptr;
+}
+byte egaTilePalettesGetTile(EGATilePalettes const *self, u32 tx, u32 ty) {
+   return tx < self->tilesX && ty < self->tilesY ? self->map[(u64)ty * self->tilesX + tx] : 0;
+}
+void egaTilePalettesSetTile(EGATilePalettes *self, u32 tx, u32 ty, byte palette) {
+   if (tx < self->tilesX && ty < self->tilesY && palette < self->palettes.size()) {
+      self->map[(u64)ty * self->tilesX + tx] = palette;
    }
-   else {
-      //region clear is just a rect render on the vp
-      egaRenderRect(target, *vp, color);
+}
+
+// a palette's cost for each of the 64 colors is the distance to the closest color it has
+static void _tilePaletteCosts(EGAPalette const &palette, f32 costs[EGA_COLORS]) {
+   auto &d = _egaDistances().d;
+   for (u32 c = 0; c < EGA_COLORS; ++c) {
+      costs[c] = FLT_MAX;
+      for (u32 i = 0; i < EGA_PALETTE_COLORS; ++i) {
+         if (palette.colors[i] < EGA_COLORS) {
+            costs[c] = MIN(costs[c], d[c][palette.colors[i]]);
+         }
+      }
    }
 }
-void egaClearAlpha(EGATexture *target) {
-   memset(target->pixelData, EGA_ALPHA, target->pixelCount);
-   target->dirty = Tex_ALL_DIRTY;
+
+static f32 _tileError(u32 const counts[EGA_COLORS], f32 const costs[EGA_COLORS]) {
+   f32 out = 0.0f;
+   for (u32 c = 0; c < EGA_COLORS; ++c) {
+      if (counts[c]) {
+         out += counts[c] * costs[c];
+      }
+   }
+   return out;
 }
 
-static void _renderTextureEX(EGATexture *dest, EGATexture *src, Recti const& srcRect, Int2 const& destPos) {
-   byte *srcPixels = src->pixelData + (srcRect.y * src->w + srcRect.x);
+// 1. every tile gets a 64 color histogram
+// 2. the first palette is solved from the whole image, then the tile the current palettes fit worst gets a new
+//    palette solved from just its own colors, until there are enough or every tile is exact
+// 3. after each new palette, lloyd: each palette is re-solved from the merged histograms of the tiles using it
+//    (in parallel) and every tile moves to whichever palette encodes it with the least error, until nothing changes
+//    none of these steps can make the total error worse, so more palettes never look worse than fewer
+// 4. the pixels get mapped the same as a normal encode but through their tile's palette
+EGATexture *egaTextureCreateFromTextureEncodeTilePalettes(Texture *source, Int2 tileSize, u32 paletteCount, EGATilePalettes **palettesOut) {
+   auto texSize = textureGetSize(source);
+   auto texColors = textureGetPixels(source);
+   if (texSize.x <= 0 || texSize.y <= 0) {
+      return nullptr;
+   }
+
+   auto self = egaTilePalettesCreate(texSize.x, texSize.y, tileSize, paletteCount);
+   u32 w = texSize.x, h = texSize.y;
+   u32 tileW = self->tileW, tileH = self->tileH, tilesX = self->tilesX;
+   u32 tileCount = (u32)self->map.size();
+   u32 maxPalettes = (u32)self->palettes.size();
+   u32 bandCount = _encodeBandCount(texSize);
+
+   std::vector<u32> hist((u64)tileCount * EGA_COLORS);
+   _encodeBands(self->tilesY, MIN(bandCount, self->tilesY), [&](u32, u32 top, u32 bottom) {
+      std::vector<byte> row(w);
+      for (u32 y = top * tileH; y < MIN(bottom * tileH, h); ++y) {
+         auto src = texColors + (u64)y * w;
+         auto tileCounts = hist.data() + (u64)(y / tileH) * tilesX * EGA_COLORS;
+         for (u32 tx = 0; tx < tilesX; ++tx) {
+            u32 x = tx * tileW;
+            _rgbToEGARow(src + x, row.data() + x, MIN(tileW, w - x), tileCounts + (u64)tx * EGA_COLORS);
+         }
+      }
+   });
+
+   EGAPalette undefined;
+   memset(undefined.colors, EGA_COLOR_UNDEFINED, sizeof(undefined.colors));
+
+   std::vector<byte> luts((u64)maxPalettes * EGA_COLORS);
+   std::vector<f32> costs((u64)maxPalettes * EGA_COLORS);
+   // the reduction is greedy so a re-solve can come out worse for the same tiles, keepBetter only takes it if it isn't
+   auto solve = [&](u32 const counts[EGA_COLORS], u32 p, bool keepBetter) {
+      EGAPalette palette;
+      byte lut[EGA_COLORS];
+      f32 paletteCosts[EGA_COLORS];
+      _reducePalette(counts, &undefined, &palette, lut);
+      _tilePaletteCosts(palette, paletteCosts);
+
+      auto current = costs.data() + (u64)p * EGA_COLORS;
+      if (keepBetter && _tileError(counts, paletteCosts) >= _tileError(counts, current)) {
+         return false;
+      }
+
+      self->palettes[p] = palette;
+      memcpy(luts.data() + (u64)p * EGA_COLORS, lut, sizeof(lut));
+      memcpy(current, paletteCosts, sizeof(paletteCosts));
+      return true;
+   };
+
+   // moves every tile to its best of the first count palettes, true if any tile changed
+   std::vector<f32> tileErrors(tileCount);
+   auto assign = [&](u32 count) {
+      std::atomic<bool> moved(false);
+      _encodeBands(tileCount, MIN(bandCount, tileCount), [&](u32, u32 first, u32 last) {
+         bool bandMoved = false;
+         for (u32 t = first; t < last; ++t) {
+            auto counts = hist.data() + (u64)t * EGA_COLORS;
+
+            f32 best = FLT_MAX;
+            byte bestPalette = 0;
+            for (u32 p = 0; p < count; ++p) {
+               f32 err = _tileError(counts, costs.data() + (u64)p * EGA_COLORS);
+               if (err < best) {
+                  best = err;
+                  bestPalette = (byte)p;
+               }
+            }
+
+            tileErrors[t] = best;
+            if (self->map[t] != bestPalette) {
+               self->map[t] = bestPalette;
+               bandMoved = true;
+            }
+         }
+
+         if (bandMoved) {
+            moved = true;
+         }
+      });
+      return moved.load();
+   };
+
+   // lloyd over the first count palettes, a palette nobody picked keeps what it had, it may still win some tiles back
+   auto refine = [&](u32 count) {
+      for (u32 i = 0; i < EGA_TILE_PALETTE_ITERATIONS; ++i) {
+         std::vector<u32> merged((u64)count * EGA_COLORS);
+         for (u32 t = 0; t < tileCount; ++t) {
+            auto counts = hist.data() + (u64)t * EGA_COLORS;
+            auto into = merged.data() + (u64)self->map[t] * EGA_COLORS;
+            for (u32 c = 0; c < EGA_COLORS; ++c) {
+               into[c] += counts[c];
+            }
+         }
+
+         std::atomic<bool> changed(false);
+         _encodeBands(count, MIN(bandCount, count), [&](u32, u32 first, u32 last) {
+            for (u32 p = first; p < last; ++p) {
+               auto counts = merged.data() + (u64)p * EGA_COLORS;
+               if (std::any_of(counts, counts + EGA_COLORS, [](u32 c) { return c != 0; }) && solve(counts, p, true)) {
+                  changed = true;
+               }
+            }
+         });
+
+         if (!changed || !assign(count)) {
+            break;
+         }
+      }
+   };
+
+   u32 used = 1;
+   {
+      u32 total[EGA_COLORS] = { 0 };
+      for (u32 t = 0; t < tileCount; ++t) {
+         for (u32 c = 0; c < EGA_COLORS; ++c) {
+            total[c] += hist[(u64)t * EGA_COLORS + c];
+         }
+      }
+      solve(total, 0, false);
+      assign(used);
+   }
+
+   while (used < maxPalettes) {
+      u32 worst = (u32)(std::max_element(tileErrors.begin(), tileErrors.end()) - tileErrors.begin());
+      if (tileErrors[worst] <= 0.0f) {
+         break;
+      }
+
+      solve(hist.data() + (u64)worst * EGA_COLORS, used++, false);
+      assign(used);
+      refine(used);
+   }
+
+   // drop palettes that ended up with no tiles
+   byte remap[EGA_MAX_TILE_PALETTES];
+   bool inUse[EGA_MAX_TILE_PALETTES] = { false };
+   for (auto p : self->map) {
+      inUse[p] = true;
+   }
+
+   u32 kept = 0;
+   for (u32 p = 0; p < used; ++p) {
+      if (inUse[p]) {
+         self->palettes[kept] = self->palettes[p];
+         memmove(luts.data() + (u64)kept * EGA_COLORS, luts.data() + (u64)p * EGA_COLORS, EGA_COLORS);
+         remap[p] = (byte)kept++;
+      }
+   }
+   self->palettes.resize(kept);
+   for (auto &p : self->map) {
+      p = remap[p];
+   }
+
+   std::vector<byte> rowLUTs((u64)kept * 256, EGA_ALPHA);
+   for (u32 p = 0; p < kept; ++p) {
+      memcpy(rowLUTs.data() + (u64)p * 256, luts.data() + (u64)p * EGA_COLORS, EGA_COLORS);
+   }
+
+   auto out = egaTextureCreate(w, h);
+   _encodeBands(h, bandCount, [&](u32, u32 top, u32 bottom) {
+      u32 counts[EGA_COLORS] = { 0 };
+      for (u32 y = top; y < bottom; ++y) {
+         auto row = out->pixelData + (u64)y * w;
+         auto tiles = self->map.data() + (u64)(y / tileH) * tilesX;
+
+         _rgbToEGARow(texColors + (u64)y * w, row, w, counts);
+         for (u32 tx = 0; tx < tilesX; ++tx) {
+            auto lut = rowLUTs.data() + (u64)tiles[tx] * 256;
+            for (u32 x = tx * tileW, right = MIN(x + tileW, w); x < right; ++x) {
+               row[x] = lut[row[x]];
+            }
+         }
+      }
+   });
+   _textureMarkAllDirty(out);
+
+   *palettesOut = self;
+   return out;
+}
+
+int egaTextureDecodeTilePalettesToBuffer(EGATexture const *self, ColorRGBA *out, EGATilePalettes const *palettes) {
+   if (!self->w || !self->h || self->w != palettes->w || self->h != palettes->h) {
+      return 0;
+   }
+
+   std::vector<EGADecodeLUT> luts(palettes->palettes.size());
+   for (u32 p = 0; p < luts.size(); ++p) {
+      _buildDecodeLUT(&palettes->palettes[p], luts[p]);
+   }
+
+   Int2 size = { (i32)self->w, (i32)self->h };
+   _encodeBands(self->h, _encodeBandCount(size), [&](u32, u32 top, u32 bottom) {
+      std::vector<byte> row(self->w);
+      for (u32 y = top; y < bottom; ++y) {
+         _texReadRow(self, 0, y, self->w, row.data());
+
+         auto dest = out + (u64)y * self->w;
+         auto tiles = palettes->map.data() + (u64)(y / palettes->tileH) * palettes->tilesX;
+         for (u32 tx = 0; tx < palettes->tilesX;) {
+            // neighboring tiles on the same palette decode together
+            u32 runEnd = tx + 1;
+            while (runEnd < palettes->tilesX && tiles[runEnd] == tiles[tx]) {
+               ++runEnd;
+            }
+
+            auto &lut = luts[tiles[tx]];
+            u32 x = tx * palettes->tileW, right = MIN(runEnd * palettes->tileW, self->w);
+
+            // the kernels cost too much to get going on a short run, a plain lookup wins there
+            if (right - x >= EGA_TILE_PALETTE_KERNEL_RUN) {
+               g_decodeKernel(row.data() + x, dest + x, right - x, lut);
+            }
+            else {
+               for (; x < right; ++x) {
+                  auto c = row[x];
+                  dest[x] = c < EGA_PALETTE_COLORS ? lut.colors[c] : ColorRGBA{ 0 };
+               }
+            }
+
+            tx = runEnd;
+         }
+      }
+   });
+
+   return 1;
+}
+
+int egaTextureDecodeTilePalettes(EGATexture const *self, Texture *target, EGATilePalettes const *palettes) {
+   auto texSize = textureGetSize(target);
+   if (texSize.x != (i32)self->w || texSize.y != (i32)self->h) {
+      return 0;
+   }
+
+   std::vector<ColorRGBA> decoded((u64)self->w * self->h);
+   if (!egaTextureDecodeTilePalettesToBuffer(self, decoded.data(), palettes)) {
+      return 0;
+   }
+
+   textureSetPixels(target, (byte*)decoded.data());
+   return 1;
+}
+
+#pragma endregion
+
+void egaTextureResize(EGATexture *self, u32 width, u32 height) {
+   if (width == self->w && height == self->h) {
+      return;
+   }
+
+   if (self->tiled) {
+      if (self->grid.chunks) {
+         _tiledResize(self, width, height);
+      }
+      else {
+         _gridInit(self->grid, width, height);
+      }
+
+      self->w = width;
+      self->h = height;
+      self->pixelCount = (u64)width * height;
+
+      if (self->decodePixels) {
+         delete[] self->decodePixels;
+         self->decodePixels = nullptr;
+      }
+   }
+   // copy over to new size if you have anything
+   else if (self->pixelData) {
+      auto copyWidth = MIN(width, self->w);
+      auto copyHeight = MIN(height, self->h);
+      auto newPixelCount = width * height;
+
+      auto newPixelData = new byte[newPixelCount];
+      memset(newPixelData, EGA_ALPHA, newPixelCount);
+
+      byte *destSL = newPixelData;
+      byte *srcSL = self->pixelData;
+      for (int y = 0; y < copyHeight; ++y) {
+         memcpy(destSL, srcSL, copyWidth);
+         destSL += width;
+         srcSL += self->w;
+      }
+
+      self->w = width;
+      self->h = height;
+      self->pixelCount = newPixelCount;
+      delete[] self->pixelData;
+      self->pixelData = newPixelData;
+
+      if (self->decodePixels) {
+         delete[] self->decodePixels;
+         self->decodePixels = nullptr;
+      }
+   }
+   else {
+      self->w = width;
+      self->h = height;
+      self->pixelCount = self->w * self->h;
+      self->pixelData = new byte[self->pixelCount];
+   }
+   
+   self->fullRegion = EGARegion{ 0, 0, (i32)self->w, (i32)self->h };   
+   _textureMarkAllDirty(self);
+}
+
+Int2 egaTextureGetSize(EGATexture const *self) { return { (i32)self->w, (i32)self->h }; }
+u64 egaTextureGetMemorySize(EGATexture const *self) {
+   u64 size = sizeof(EGATexture);
+   if (self->tiled) {
+      auto &g = self->grid;
+      size += (u64)g.chunksX * g.chunksY * sizeof(*g.chunks);
+      for (u64 i = 0; i < (u64)g.chunksX * g.chunksY; ++i) {
+         size += g.chunks[i].load() ? EGA_CHUNK_TILES * sizeof(byte*) : 0;
+      }
+      _gridEach(g, [&](byte *&, u32, u32) { size += EGA_TILE_PIXELS; });
+   }
+   else {
+      size += self->pixelCount;
+   }
+
+   if (self->decodePixels) {
+      size += self->pixelCount * sizeof(ColorRGBA);
+   }
+   return size;
+}
+Recti const *egaTextureGetDirtyRects(EGATexture *self, u32 *countOut) {
+   if (self->dirty & Tex_DECODE_DIRTY) {
+      *countOut = 1;
+      return &self->fullRegion;
+   }
+
+   *countOut = self->dirtyRectCount;
+   return self->dirtyRects;
+}
+EGARegion *egaTextureGetFullRegion(EGATexture *self) { return &self->fullRegion; }
+
+EGAPColor egaTextureGetColorAt(EGATexture *self, u32 x, u32 y, EGARegion *vp) {
+   if (!vp) { vp = &self->fullRegion; }
+
+   if (x >= vp->w || y >= vp->h) {
+      return EGA_COLOR_UNDEFINED;
+   }
+
+   x += vp->x;
+   y += vp->y;
+
+   if (x >= self->w || y >= self->h ||
+      x < 0 || y < 0) {
+      return EGA_COLOR_UNDEFINED;
+   }
+
+   auto c = *_texReadPtr(self, x, y);
+   if (c < EGA_PALETTE_COLORS) {
+      return c;
+   }
+   
+   return EGA_COLOR_UNDEFINED;
+}
+
+void egaTextureGetIndices(EGATexture const *self, byte *out) {
+   for (u32 y = 0; y < self->h; ++y) {
+      _texReadRow(self, 0, y, self->w, out + (u64)y * self->w);
+   }
+}
+
+#pragma region RASTERIZER
+
+/*
+Every primitive resolves its region once into an EGARaster and then writes horizontal spans
+coords going into the _raster calls are region-relative, clipping is a couple of compares per span
+and the dirty rect gets marked once at the end from the touched bounds
+
+Clipping is exact per pixel so a primitive can also be limited to a band of texture rows and
+running it once per band gives the same pixels as running it whole, command lists rely on that
+*/
+
+struct EGARaster {
+   EGATexture *target = nullptr;
+   i32 ox = 0, oy = 0;                  // region origin in texture coords
+   i32 left, top, right, bottom;        // clip in region coords, right/bottom exclusive
+   i32 minX, minY, maxX, maxY;          // touched bounds in region coords
+};
+
+// returns false if the region doesnt overlap the texture at all
+// bandTop/bandBottom further limit writes to those texture rows, bottom exclusive
+static bool _rasterBegin(EGARaster &r, EGATexture *target, EGARegion const *vp, i32 bandTop = 0, i32 bandBottom = INT32_MAX) {
+   if (!vp) { vp = &target->fullRegion; }
+
+   r.target = target;
+   r.ox = vp->x;
+   r.oy = vp->y;
+   r.left = MAX(0, -vp->x);
+   r.top = MAX(0, -vp->y);
+   r.right = MIN(vp->w, (i32)target->w - vp->x);
+   r.bottom = MIN(vp->h, (i32)target->h - vp->y);
+   r.top = (i32)MAX((i64)r.top, (i64)bandTop - vp->y);
+   r.bottom = (i32)MIN((i64)r.bottom, (i64)bandBottom - vp->y);
+
+   r.minX = r.minY = INT32_MAX;
+   r.maxX = r.maxY = INT32_MIN;
+
+   return r.left < r.right && r.top < r.bottom;
+}
+
+// touched bounds in texture coords, false if nothing was written
+static bool _rasterTouched(EGARaster const &r, Recti &out) {
+   if (r.minX > r.maxX) {
+      return false;
+   }
+
+   out = { r.minX + r.ox, r.minY + r.oy, r.maxX - r.minX + 1, r.maxY - r.minY + 1 };
+   return true;
+}
+
+static void _rasterEnd(EGARaster &r) {
+   Recti touched;
+   if (_rasterTouched(r, touched)) {
+      _textureMarkDirty(r.target, touched);
+   }
+}
+
+// linear targets only
+static byte *_rasterRow(EGARaster const &r, i32 y) {
+   return r.target->pixelData + ((i64)(y + r.oy) * r.target->w + r.ox);
+}
+
+static void _rasterTouch(EGARaster &r, i32 x1, i32 y1, i32 x2, i32 y2) {
+   r.minX = MIN(r.minX, x1);
+   r.minY = MIN(r.minY, y1);
+   r.maxX = MAX(r.maxX, x2);
+   r.maxY = MAX(r.maxY, y2);
+}
+
+// x1 to x2 inclusive
+static void _rasterSpan(EGARaster &r, i32 x1, i32 x2, i32 y, EGAPColor color) {
+   if (y < r.top || y >= r.bottom) {
+      return;
+   }
+
+   x1 = MAX(x1, r.left);
+   x2 = MIN(x2, r.right - 1);
+   if (x1 > x2) {
+      return;
+   }
+
+   _texFill(r.target, x1 + r.ox, y + r.oy, x2 - x1 + 1, color);
+   _rasterTouch(r, x1, y, x2, y);
+}
+
+static void _rasterPoint(EGARaster &r, i32 x, i32 y, EGAPColor color) {
+   if (x < r.left || x >= r.right || y < r.top || y >= r.bottom) {
+      return;
+   }
+
+   _texSetPixel(r.target, x + r.ox, y + r.oy, color);
+   _rasterTouch(r, x, y, x, y);
+}
+
+// y1 to y2 inclusive
+static void _rasterColumn(EGARaster &r, i32 x, i32 y1, i32 y2, EGAPColor color) {
+   if (x < r.left || x >= r.right) {
+      return;
+   }
+
+   y1 = MAX(y1, r.top);
+   y2 = MIN(y2, r.bottom - 1);
+   if (y1 > y2) {
+      return;
+   }
+
+   if (r.target->tiled) {
+      for (i32 y = y1; y <= y2; ++y) {
+         _texSetPixel(r.target, x + r.ox, y + r.oy, color);
+      }
+   }
+   else {
+      byte *dest = _rasterRow(r, y1) + x;
+      for (i32 y = y1; y <= y2; ++y) {
+         *dest = color;
+         dest += r.target->w;
+      }
+   }
+   _rasterTouch(r, x, y1, x, y2);
+}
+
+// inclusive on both corners
+static void _rasterFill(EGARaster &r, i32 x1, i32 y1, i32 x2, i32 y2, EGAPColor color) {
+   x1 = MAX(x1, r.left);
+   y1 = MAX(y1, r.top);
+   x2 = MIN(x2, r.right - 1);
+   y2 = MIN(y2, r.bottom - 1);
+   if (x1 > x2 || y1 > y2) {
+      return;
+   }
+
+   i32 w = x2 - x1 + 1;
+   if (!r.target->tiled && (u32)w == r.target->w) {
+      memset(_rasterRow(r, y1) + x1, color, (u64)w * (y2 - y1 + 1)); // full rows are contiguous
+   }
+   else {
+      for (i32 y = y1; y <= y2; ++y) {
+         _texFill(r.target, x1 + r.ox, y + r.oy, w, color);
+      }
+   }
+   _rasterTouch(r, x1, y1, x2, y2);
+}
+
+// Clips a blit of src (in the source texture) to pos (relative to vp) against vp and the destination size
+// src and pos get adjusted in place, returns false if nothing is left to draw
+static bool _clipBlit(EGARegion const &vp, u32 destW, u32 destH, Recti &src, Int2 &pos, i32 bandTop = 0, i32 bandBottom = INT32_MAX) {
+   i32 left = MAX(vp.x, 0), top = MAX(MAX(vp.y, 0), bandTop);
+   i32 right = MIN(vp.x + vp.w, (i32)destW), bottom = MIN(MIN(vp.y + vp.h, (i32)destH), bandBottom);
+
+   i32 x = pos.x + vp.x, y = pos.y + vp.y;
+   if (x < left) { src.x += left - x; src.w -= left - x; x = left; }
+   if (y < top) { src.y += top - y; src.h -= top - y; y = top; }
+   src.w = MIN(src.w, right - x);
+   src.h = MIN(src.h, bottom - y);
+
+   pos = { x, y };
+   return src.w > 0 && src.h > 0;
+}
+
+#pragma endregion
+
+#pragma region PACKED TEXTURES
+
+/*
+packed pixel data organization
+
+Rows are padded out to 64-bit words so every row starts aligned
+nibbles: 16 pixels per word, pixel x is at bit 4*(x%16), transparent pixels store 0
+mask: 64 pixels per word, pixel x is bit x%64, set means opaque
+*/
+
+struct EGAPackedTexture {
+   u32 w = 0, h = 0;
+   u32 nibbleWords = 0, maskWords = 0; // per row
+
+   u64 *nibbles = nullptr;
+   u64 *mask = nullptr;
+
+   bool view = false; // nibbles and mask belong to someone else's buffer
+};
+
+static u64 _bitsRead(u64 const *row, u32 rowWords, u32 bit, u32 count) {
+   u32 w = bit >> 6, s = bit & 63;
+   u64 out = row[w] >> s;
+   if (s && s + count > 64 && w + 1 < rowWords) {
+      out |= row[w + 1] << (64 - s);
+   }
+   return count == 64 ? out : out & ((1ull << count) - 1);
+}
+
+// replaces the bits set in mask (already limited to count bits) with value
+static void _bitsBlend(u64 *row, u32 bit, u32 count, u64 value, u64 mask) {
+   u32 w = bit >> 6, s = bit & 63;
+   value &= mask;
+   row[w] = (row[w] & ~(mask << s)) | (value << s);
+   if (s && s + count > 64) {
+      row[w + 1] = (row[w + 1] & ~(mask >> (64 - s))) | (value >> (64 - s));
+   }
+}
+
+// spreads 16 mask bits out to a full nibble per bit
+static u64 _expandMask16(u64 m) {
+   m &= 0xFFFF;
+   m = (m | (m << 24)) & 0x000000FF000000FFull;
+   m = (m | (m << 12)) & 0x000F000F000F000Full;
+   m = (m | (m << 6)) & 0x0303030303030303ull;
+   m = (m | (m << 3)) & 0x1111111111111111ull;
+   return m * 0xF;
+}
+
+static u64 *_packedNibbleRow(EGAPackedTexture const *self, u32 y) { return self->nibbles + (u64)y * self->nibbleWords; }
+static u64 *_packedMaskRow(EGAPackedTexture const *self, u32 y) { return self->mask + (u64)y * self->maskWords; }
+
+// expands count pixels starting at x of a packed row into index bytes, EGA_ALPHA for transparent
+static void _packedUnpackRow(EGAPackedTexture const *self, u32 y, u32 x, u32 count, byte *out) {
+   auto nibbles = _packedNibbleRow(self, y);
+   auto mask = _packedMaskRow(self, y);
+
+   while (count) {
+      u32 run = MIN(count, 16u);
+      u64 n = _bitsRead(nibbles, self->nibbleWords, x * 4, run * 4);
+      u64 m = _bitsRead(mask, self->maskWords, x, run);
+
+      for (u32 i = 0; i < run; ++i) {
+         out[i] = (m >> i) & 1 ? (byte)((n >> (i * 4)) & 15) : EGA_ALPHA;
+      }
+
+      out += run; x += run; count -= run;
+   }
+}
+
+// packs count index bytes into a packed row starting at x, all pixels are overwritten
+static void _packedPackRow(EGAPackedTexture *self, u32 y, u32 x, u32 count, byte const *in) {
+   auto nibbles = _packedNibbleRow(self, y);
+   auto mask = _packedMaskRow(self, y);
+
+   while (count) {
+      u32 run = MIN(count, 16u);
+      u64 n = 0, m = 0;
+
+      for (u32 i = 0; i < run; ++i) {
+         if (in[i] < EGA_PALETTE_COLORS) {
+            n |= (u64)in[i] << (i * 4);
+            m |= 1ull << i;
+         }
+      }
+
+      _bitsBlend(nibbles, x * 4, run * 4, n, run == 16 ? ~0ull : (1ull << (run * 4)) - 1);
+      _bitsBlend(mask, x, run, m, (1ull << run) - 1);
+
+      in += run; x += run; count -= run;
+   }
+}
+
+EGAPackedTexture *egaPackedTextureCreate(u32 width, u32 height) {
+   auto self = new EGAPackedTexture();
+   self->w = width;
+   self->h = height;
+   self->nibbleWords = (width + 15) / 16;
+   self->maskWords = (width + 63) / 64;
+   self->nibbles = new u64[(u64)self->nibbleWords * height];
+   self->mask = new u64[(u64)self->maskWords * height];
+
+   egaPackedTextureClear(self, EGA_ALPHA);
+   return self;
+}
+EGAPackedTexture *egaPackedTextureCreateFromTexture(EGATexture const *source) {
+   auto self = egaPackedTextureCreate(source->w, source->h);
+   std::vector<byte> row(source->tiled ? source->w : 0);
+
+   for (u32 y = 0; y < self->h; ++y) {
+      if (source->tiled) {
+         _texReadRow(source, 0, y, source->w, row.data());
+         _packedPackRow(self, y, 0, self->w, row.data());
+      }
+      else {
+         _packedPackRow(self, y, 0, self->w, source->pixelData + (u64)y * source->w);
+      }
+   }
+   return self;
+}
+void egaPackedTextureDestroy(EGAPackedTexture *self) {
+   if (!self->view) {
+      delete[] self->nibbles;
+      delete[] self->mask;
+   }
+   delete self;
+}
+
+Int2 egaPackedTextureGetSize(EGAPackedTexture const *self) { return { (i32)self->w, (i32)self->h }; }
+u64 egaPackedTextureGetMemorySize(EGAPackedTexture const *self) {
+   return sizeof(EGAPackedTexture) + ((u64)self->nibbleWords + self->maskWords) * self->h * sizeof(u64);
+}
+
+EGAPColor egaPackedTextureGetColorAt(EGAPackedTexture const *self, u32 x, u32 y) {
+   if (x >= self->w || y >= self->h) {
+      return EGA_COLOR_UNDEFINED;
+   }
+
+   if (!((_packedMaskRow(self, y)[x >> 6] >> (x & 63)) & 1)) {
+      return EGA_COLOR_UNDEFINED;
+   }
+
+   return (_packedNibbleRow(self, y)[x >> 4] >> ((x & 15) * 4)) & 15;
+}
+void egaPackedTextureSetColorAt(EGAPackedTexture *self, u32 x, u32 y, EGAPColor color) {
+   if (!self->view && x < self->w && y < self->h) {
+      _packedPackRow(self, y, x, 1, &color);
+   }
+}
+
+void egaPackedTextureClear(EGAPackedTexture *self, EGAPColor color) {
+   if (self->view) {
+      return;
+   }
+
+   bool opaque = color < EGA_PALETTE_COLORS;
+   u64 nibbleFill = opaque ? color * 0x1111111111111111ull : 0;
+   u64 nibbleCount = (u64)self->nibbleWords * self->h;
+
+   for (u64 i = 0; i < nibbleCount; ++i) {
+      self->nibbles[i] = nibbleFill;
+   }
+
+   memset(self->mask, 0, (u64)self->maskWords * self->h * sizeof(u64));
+   if (opaque) {
+      // leave the row padding bits clear
+      for (u32 y = 0; y < self->h; ++y) {
+         auto mask = _packedMaskRow(self, y);
+         for (u32 x = 0; x < self->w; x += 64) {
+            u32 run = MIN(self->w - x, 64u);
+            mask[x >> 6] = run == 64 ? ~0ull : (1ull << run) - 1;
+         }
+      }
+   }
+}
+
+void egaPackedTextureRender(EGAPackedTexture *target, Int2 pos, EGAPackedTexture const *tex) {
+   if (target->view) {
+      return;
+   }
+
+   Recti src = { 0, 0, (i32)tex->w, (i32)tex->h };
+   EGARegion full = { 0, 0, (i32)target->w, (i32)target->h };
+   if (!_clipBlit(full, target->w, target->h, src, pos)) {
+      return;
+   }
+
+   // 16 pixels per step, the source mask expanded to nibbles selects what gets written
+   for (i32 y = 0; y < src.h; ++y) {
+      auto srcNibbles = _packedNibbleRow(tex, src.y + y);
+      auto srcMask = _packedMaskRow(tex, src.y + y);
+      auto destNibbles = _packedNibbleRow(target, pos.y + y);
+      auto destMask = _packedMaskRow(target, pos.y + y);
+
+      for (i32 x = 0; x < src.w; x += 16) {
+         u32 run = MIN(src.w - x, 16);
+         u32 sx = src.x + x, dx = pos.x + x;
+
+         u64 m = _bitsRead(srcMask, tex->maskWords, sx, run);
+         if (!m) {
+            continue;
+         }
+
+         u64 n = _bitsRead(srcNibbles, tex->nibbleWords, sx * 4, run * 4);
+         _bitsBlend(destNibbles, dx * 4, run * 4, n, _expandMask16(m));
+         _bitsBlend(destMask, dx, run, m, m);
+      }
+   }
+}
+
+void egaRenderPackedTexture(EGATexture *target, Int2 pos, EGAPackedTexture const *tex, EGARegion *vp) {
+   if (!vp) { vp = &target->fullRegion; }
+
+   Recti src = { 0, 0, (i32)tex->w, (i32)tex->h };
+   if (!_clipBlit(*vp, target->w, target->h, src, pos)) {
+      return;
+   }
+
+   if (target->tiled) {
+      std::vector<byte> row(src.w);
+      for (i32 y = 0; y < src.h; ++y) {
+         _packedUnpackRow(tex, src.y + y, src.x, src.w, row.data());
+         _texBlendRow(target, pos.x, pos.y + y, src.w, row.data());
+      }
+
+      _textureMarkDirty(target, { pos.x, pos.y, src.w, src.h });
+      return;
+   }
+
+   for (i32 y = 0; y < src.h; ++y) {
+      auto nibbles = _packedNibbleRow(tex, src.y + y);
+      auto mask = _packedMaskRow(tex, src.y + y);
+      byte *dest = target->pixelData + (u64)(pos.y + y) * target->w + pos.x;
+
+      for (i32 x = 0; x < src.w; x += 16) {
+         u32 run = MIN(src.w - x, 16);
+         u32 sx = src.x + x;
+
+         u64 m = _bitsRead(mask, tex->maskWords, sx, run);
+         if (!m) {
+            continue; // fully transparent run
+         }
+
+         u64 n = _bitsRead(nibbles, tex->nibbleWords, sx * 4, run * 4);
+         if (m == (1ull << run) - 1) {
+            for (u32 i = 0; i < run; ++i) {
+               dest[x + i] = (n >> (i * 4)) & 15;
+            }
+         }
+         else {
+            for (u32 i = 0; i < run; ++i) {
+               if ((m >> i) & 1) {
+                  dest[x + i] = (n >> (i * 4)) & 15;
+               }
+            }
+         }
+      }
+   }
+
+   _textureMarkDirty(target, { pos.x, pos.y, src.w, src.h });
+}
+
+int egaPackedTextureDecode(EGAPackedTexture const *self, Texture *target, EGAPalette *palette) {
+   auto texSize = textureGetSize(target);
+   if ((u32)texSize.x != self->w || (u32)texSize.y != self->h) {
+      return 0;
+   }
+
+   EGADecodeLUT lut;
+   _buildDecodeLUT(palette, lut);
+
+   // unpack a row at a time and let the decode kernel take it from there
+   std::vector<byte> row(self->w);
+   std::vector<ColorRGBA> decoded((u64)self->w * self->h);
+   for (u32 y = 0; y < self->h; ++y) {
+      _packedUnpackRow(self, y, 0, self->w, row.data());
+      g_decodeKernel(row.data(), decoded.data() + (u64)y * self->w, self->w, lut);
+   }
+
+   textureSetPixels(target, (byte*)decoded.data());
+   return 1;
+}
+
+#pragma endregion
+
+#pragma region SERIALIZATION
+
+/*
+serialized textures are an SCF document of
+   int version, int format, int width, int height, then the payload
+
+PACKED: bytes nibbles, bytes mask
+   exactly the rows of an EGAPackedTexture, SCF keeps bytes 8-byte aligned so a view can use them in place
+
+SPANS: bytes spans
+   every row on its own, a series of (n - 1) in the low 6 bits of a tag byte:
+   0x00 skip    n transparent pixels
+   0x40 literal n pixels, followed by (n + 1) / 2 bytes of them packed low nibble first
+   0x80 run     n pixels of the color in the next byte
+*/
+
+#define EGA_SERIAL_VERSION 1
+#define EGA_SPAN_MAX 64
+#define EGA_SPAN_MIN_RUN 3 // shorter than this is cheaper as literals
+
+enum {
+   EGASpan_SKIP = 0x00,
+   EGASpan_LITERAL = 0x40,
+   EGASpan_RUN = 0x80,
+   EGASpan_TAG = 0xC0
+};
+
+struct EGASerialized {
+   EGATextureFormat format = 0;
+   u32 w = 0, h = 0;
+   byte const *payload[2] = { nullptr };
+   u32 payloadSize[2] = { 0 };
+};
+
+static u32 _spanRun(byte const *row, u32 x, u32 w) {
+   u32 n = 1;
+   while (x + n < w && n < EGA_SPAN_MAX && row[x + n] == row[x]) {
+      ++n;
+   }
+   return n;
+}
+
+static void _spansEncodeRow(byte const *row, u32 w, std::vector<byte> &out) {
+   for (u32 x = 0; x < w;) {
+      u32 n = 1;
+      if (row[x] >= EGA_PALETTE_COLORS) {
+         while (x + n < w && n < EGA_SPAN_MAX && row[x + n] >= EGA_PALETTE_COLORS) {
+            ++n;
+         }
+         out.push_back(EGASpan_SKIP | (byte)(n - 1));
+      }
+      else if ((n = _spanRun(row, x, w)) >= EGA_SPAN_MIN_RUN) {
+         out.push_back(EGASpan_RUN | (byte)(n - 1));
+         out.push_back(row[x]);
+      }
+      else {
+         // literals until the row goes transparent or there's a run worth stopping for
+         n = 1;
+         while (x + n < w && n < EGA_SPAN_MAX && row[x + n] < EGA_PALETTE_COLORS && _spanRun(row, x + n, w) < EGA_SPAN_MIN_RUN) {
+            ++n;
+         }
+
+         out.push_back(EGASpan_LITERAL | (byte)(n - 1));
+         for (u32 i = 0; i < n; i += 2) {
+            out.push_back(row[x + i] | (i + 1 < n ? row[x + i + 1] << 4 : 0));
+         }
+      }
+      x += n;
+   }
+}
+
+// false if the spans run out or don't line up with the row
+static bool _spansDecodeRow(byte const *&src, byte const *end, byte *row, u32 w) {
+   for (u32 x = 0; x < w;) {
+      if (src >= end) {
+         return false;
+      }
+
+      byte tag = *src++;
+      u32 n = (tag & ~EGASpan_TAG) + 1;
+      if (x + n > w) {
+         return false;
+      }
+
+      switch (tag & EGASpan_TAG) {
+      case EGASpan_SKIP:
+         memset(row + x, EGA_ALPHA, n);
+         break;
+      case EGASpan_RUN:
+         if (src >= end) {
+            return false;
+         }
+         memset(row + x, *src++ & 15, n);
+         break;
+      case EGASpan_LITERAL: {
+         u32 bytes = (n + 1) / 2;
+         if ((u64)(end - src) < bytes) {
+            return false;
+         }
+         for (u32 i = 0; i < n; ++i) {
+            row[x + i] = (src[i >> 1] >> ((i & 1) * 4)) & 15;
+         }
+         src += bytes;
+      }  break;
+      default:
+         return false;
+      }
+
+      x += n;
+   }
+   return true;
+}
+
+static bool _serialRead(byte const *buff, u64 size, EGASerialized &out) {
+   auto view = scfViewBuffer(buff, size);
+   if (scfReaderNull(view)) {
+      return false;
+   }
+
+   auto version = scfReadInt(view);
+   auto format = scfReadInt(view);
+   auto w = scfReadInt(view);
+   auto h = scfReadInt(view);
+   if (!version || !format || !w || !h || *version != EGA_SERIAL_VERSION || *w <= 0 || *h <= 0 ||
+      (u64)*w * *h > EGA_SERIAL_MAX_PIXELS) {
+      return false;
+   }
+
+   out.format = (EGATextureFormat)*format;
+   out.w = *w;
+   out.h = *h;
+
+   u32 payloads = out.format == EGATextureFormat_PACKED ? 2 : out.format == EGATextureFormat_SPANS ? 1 : 0;
+   if (!payloads) {
+      return false;
+   }
+
+   for (u32 i = 0; i < payloads; ++i) {
+      out.payload[i] = scfReadBytes(view, &out.payloadSize[i]);
+      if (!out.payload[i] || out.payload[i] < buff || out.payload[i] + out.payloadSize[i] > buff + size) {
+         return false;
+      }
+   }
+
+   if (out.format == EGATextureFormat_PACKED) {
+      return out.payloadSize[0] == (u64)(out.w + 15) / 16 * out.h * sizeof(u64) &&
+         out.payloadSize[1] == (u64)(out.w + 63) / 64 * out.h * sizeof(u64);
+   }
+
+   // every row takes at least one tag per EGA_SPAN_MAX pixels, check before anything gets allocated for it
+   return out.payloadSize[0] >= (u64)(out.w + EGA_SPAN_MAX - 1) / EGA_SPAN_MAX * out.h;
+}
+
+int egaTextureSerialize(EGATexture *self, byte **outBuff, u64 *size, EGATextureFormat format) {
+   // deserialize won't take anything bigger, don't write what can't be read back
+   if (!self->w || !self->h || (u64)self->w * self->h > EGA_SERIAL_MAX_PIXELS) {
+      return 0;
+   }
+
+   u64 packedSize = ((u64)(self->w + 15) / 16 + (self->w + 63) / 64) * self->h * sizeof(u64);
+
+   std::vector<byte> spans;
+   if (format != EGATextureFormat_PACKED) {
+      std::vector<byte> row(self->w);
+      for (u32 y = 0; y < self->h; ++y) {
+         _texReadRow(self, 0, y, self->w, row.data());
+         _spansEncodeRow(row.data(), self->w, spans);
+      }
+
+      if (format == EGATextureFormat_AUTO) {
+         format = spans.size() < packedSize ? EGATextureFormat_SPANS : EGATextureFormat_PACKED;
+      }
+   }
+
+   // SCF sizes are 32-bit
+   if ((format == EGATextureFormat_PACKED ? packedSize : spans.size()) > 0xFFFF0000ull) {
+      return 0;
+   }
+
+   auto writer = scfWriterCreate();
+   scfWriteInt(writer, EGA_SERIAL_VERSION);
+   scfWriteInt(writer, format);
+   scfWriteInt(writer, self->w);
+   scfWriteInt(writer, self->h);
+
+   if (format == EGATextureFormat_PACKED) {
+      auto packed = egaPackedTextureCreateFromTexture(self);
+      scfWriteBytes(writer, packed->nibbles, (u32)((u64)packed->nibbleWords * packed->h * sizeof(u64)));
+      scfWriteBytes(writer, packed->mask, (u32)((u64)packed->maskWords * packed->h * sizeof(u64)));
+      egaPackedTextureDestroy(packed);
+   }
+   else {
+      scfWriteBytes(writer, spans.data(), (u32)spans.size());
+   }
+
+   u32 bSize = 0;
+   *outBuff = (byte*)scfWriteToBuffer(writer, &bSize);
+   *size = bSize;
+
+   scfWriterDestroy(writer);
+   return 1;
+}
+
+EGATexture *egaTextureDeserialize(byte const *buff, u64 size) {
+   EGASerialized s;
+   if (!_serialRead(buff, size, s)) {
+      return nullptr;
+   }
+
+   auto out = egaTextureCreate(s.w, s.h);
+
+   if (s.format == EGATextureFormat_PACKED) {
+      // a packed texture over the payload, copied out first if it isn't aligned for u64 reads
+      std::vector<u64> aligned;
+      EGAPackedTexture packed;
+      packed.w = s.w;
+      packed.h = s.h;
+      packed.nibbleWords = (s.w + 15) / 16;
+      packed.maskWords = (s.w + 63) / 64;
+      packed.nibbles = (u64*)s.payload[0];
+      packed.mask = (u64*)s.payload[1];
+
+      if (((uPtr)s.payload[0] | (uPtr)s.payload[1]) & 7) {
+         aligned.resize((s.payloadSize[0] + s.payloadSize[1]) / sizeof(u64));
+         memcpy(aligned.data(), s.payload[0], s.payloadSize[0]);
+         memcpy(aligned.data() + s.payloadSize[0] / sizeof(u64), s.payload[1], s.payloadSize[1]);
+         packed.nibbles = aligned.data();
+         packed.mask = aligned.data() + s.payloadSize[0] / sizeof(u64);
+      }
+
+      for (u32 y = 0; y < s.h; ++y) {
+         _packedUnpackRow(&packed, y, 0, s.w, out->pixelData + (u64)y * s.w);
+      }
+   }
+   else {
+      auto src = s.payload[0], end = src + s.payloadSize[0];
+      for (u32 y = 0; y < s.h; ++y) {
+         if (!_spansDecodeRow(src, end, out->pixelData + (u64)y * s.w, s.w)) {
+            egaTextureDestroy(out);
+            return nullptr;
+         }
+      }
+   }
+
+   _textureMarkAllDirty(out);
+   return out;
+}
+
+EGAPackedTexture *egaPackedTextureCreateView(byte const *buff, u64 size) {
+   EGASerialized s;
+   if (!_serialRead(buff, size, s) || s.format != EGATextureFormat_PACKED || (((uPtr)s.payload[0] | (uPtr)s.payload[1]) & 7)) {
+      return nullptr;
+   }
+
+   auto self = new EGAPackedTexture();
+   self->w = s.w;
+   self->h = s.h;
+   self->nibbleWords = (s.w + 15) / 16;
+   self->maskWords = (s.w + 63) / 64;
+   self->nibbles = (u64*)s.payload[0];
+   self->mask = (u64*)s.payload[1];
+   self->view = true;
+   return self;
+}
+
+#pragma endregion
+
+#pragma region HISTORY
+
+/*
+Revisions are a grid of EGA_TILE_SIZE tiles (edge tiles clipped to the texture)
+Tiles are immutable and refcounted, a new revision shares every tile that didnt change from the one before it
+so a stroke only costs the handful of tiles it touched
+Uniform tiles (blank canvas, big fills) keep just the color, everything else is a packed texture
+*/
+
+struct EGAHistoryTile {
+   u32 refs = 1;
+   EGAPColor solid = EGA_ALPHA; // the whole tile when pixels is null
+   EGAPackedTexture *pixels = nullptr;
+};
+
+struct EGARevision {
+   u32 w = 0, h = 0;
+   u32 tilesX = 0, tilesY = 0;
+   std::vector<EGAHistoryTile*> tiles;
+};
+
+struct EGAHistory {
+   u64 budget = 0;
+   u64 memory = 0;
+
+   std::vector<EGARevision*> revisions;
+   u32 position = 0;
+};
+
+static u64 _historyTileMemory(EGAHistoryTile const *tile) {
+   return sizeof(EGAHistoryTile) + (tile->pixels ? egaPackedTextureGetMemorySize(tile->pixels) : 0);
+}
+
+static u64 _revisionMemory(EGARevision const *rev) {
+   return sizeof(EGARevision) + rev->tiles.size() * sizeof(EGAHistoryTile*);
+}
+
+static void _historyTileRelease(EGAHistory *self, EGAHistoryTile *tile) {
+   if (--tile->refs == 0) {
+      self->memory -= _historyTileMemory(tile);
+      if (tile->pixels) {
+         egaPackedTextureDestroy(tile->pixels);
+      }
+      delete tile;
+   }
+}
+
+static void _revisionDestroy(EGAHistory *self, EGARevision *rev) {
+   for (auto tile : rev->tiles) {
+      _historyTileRelease(self, tile);
+   }
+   self->memory -= _revisionMemory(rev);
+   delete rev;
+}
+
+static Recti _revisionTileRect(EGARevision const *rev, u32 tx, u32 ty) {
+   i32 x = tx * EGA_TILE_SIZE, y = ty * EGA_TILE_SIZE;
+   return { x, y, MIN((i32)EGA_TILE_SIZE, (i32)rev->w - x), MIN((i32)EGA_TILE_SIZE, (i32)rev->h - y) };
+}
+
+// row y of a history tile as index bytes
+static void _historyTileRow(EGAHistoryTile const *tile, u32 y, u32 w, byte *out) {
+   if (tile->pixels) {
+      _packedUnpackRow(tile->pixels, y, 0, w, out);
+   }
+   else {
+      memset(out, tile->solid, w);
+   }
+}
+
+static bool _historyTileMatches(EGAHistoryTile const *tile, EGATexture const *tex, Recti const &r) {
+   byte stored[EGA_TILE_SIZE], current[EGA_TILE_SIZE];
+   for (i32 y = 0; y < r.h; ++y) {
+      _historyTileRow(tile, y, r.w, stored);
+      _texReadRow(tex, r.x, r.y + y, r.w, current);
+      if (memcmp(stored, current, r.w)) {
+         return false;
+      }
+   }
+   return true;
+}
+
+static EGAHistoryTile *_historyTileCreate(EGAHistory *self, EGATexture const *tex, Recti const &r) {
+   auto tile = new EGAHistoryTile();
+
+   byte row[EGA_TILE_SIZE];
+   bool uniform = true;
+   for (i32 y = 0; y < r.h; ++y) {
+      _texReadRow(tex, r.x, r.y + y, r.w, row);
+
+      if (uniform) {
+         if (y == 0) {
+            tile->solid = row[0] < EGA_PALETTE_COLORS ? row[0] : EGA_ALPHA;
+         }
+         for (i32 x = 0; x < r.w && uniform; ++x) {
+            uniform = row[x] == tile->solid || (row[x] >= EGA_PALETTE_COLORS && tile->solid == EGA_ALPHA);
+         }
+
+         if (!uniform) {
+            // rows so far were all the solid color
+            tile->pixels = egaPackedTextureCreate(r.w, r.h);
+            if (tile->solid != EGA_ALPHA) {
+               byte fill[EGA_TILE_SIZE];
+               memset(fill, tile->solid, r.w);
+               for (i32 prev = 0; prev < y; ++prev) {
+                  _packedPackRow(tile->pixels, prev, 0, r.w, fill);
+               }
+            }
+         }
+      }
+
+      if (!uniform) {
+         _packedPackRow(tile->pixels, y, 0, r.w, row);
+      }
+   }
+
+   self->memory += _historyTileMemory(tile);
+   return tile;
+}
+
+EGAHistory *egaHistoryCreate(u64 memoryBudget) {
+   auto self = new EGAHistory();
+   self->budget = memoryBudget;
+   return self;
+}
+void egaHistoryDestroy(EGAHistory *self) {
+   egaHistoryClear(self);
+   delete self;
+}
+void egaHistoryClear(EGAHistory *self) {
+   for (auto rev : self->revisions) {
+      _revisionDestroy(self, rev);
+   }
+   self->revisions.clear();
+   self->position = 0;
+}
+
+void egaHistoryCommit(EGAHistory *self, EGATexture const *tex) {
+   // committing drops anything you could have redone
+   while (self->revisions.size() > self->position + 1) {
+      _revisionDestroy(self, self->revisions.back());
+      self->revisions.pop_back();
+   }
+
+   auto prev = self->revisions.empty() ? nullptr : self->revisions.back();
+   bool sameSize = prev && prev->w == tex->w && prev->h == tex->h;
+
+   auto rev = new EGARevision();
+   rev->w = tex->w;
+   rev->h = tex->h;
+   rev->tilesX = (tex->w + EGA_TILE_SIZE - 1) / EGA_TILE_SIZE;
+   rev->tilesY = (tex->h + EGA_TILE_SIZE - 1) / EGA_TILE_SIZE;
+   rev->tiles.resize((u64)rev->tilesX * rev->tilesY);
+   self->memory += _revisionMemory(rev);
+
+   for (u32 ty = 0; ty < rev->tilesY; ++ty) {
+      for (u32 tx = 0; tx < rev->tilesX; ++tx) {
+         u64 i = (u64)ty * rev->tilesX + tx;
+         auto r = _revisionTileRect(rev, tx, ty);
+
+         if (sameSize && _historyTileMatches(prev->tiles[i], tex, r)) {
+            rev->tiles[i] = prev->tiles[i];
+            ++rev->tiles[i]->refs;
+         }
+         else {
+            rev->tiles[i] = _historyTileCreate(self, tex, r);
+         }
+      }
+   }
+
+   self->revisions.push_back(rev);
+   self->position = (u32)self->revisions.size() - 1;
+
+   // over budget, oldest revisions go first but the current one always stays
+   while (self->budget && self->memory > self->budget && self->position > 0) {
+      _revisionDestroy(self, self->revisions.front());
+      self->revisions.erase(self->revisions.begin());
+      --self->position;
+   }
+}
+
+// writes back only the tiles that differ from the revision
+static void _historyRestore(EGAHistory *self, EGATexture *target) {
+   auto rev = self->revisions[self->position];
+   if (target->w != rev->w || target->h != rev->h) {
+      egaTextureResize(target, rev->w, rev->h);
+   }
+
+   byte row[EGA_TILE_SIZE];
+   for (u32 ty = 0; ty < rev->tilesY; ++ty) {
+      for (u32 tx = 0; tx < rev->tilesX; ++tx) {
+         auto tile = rev->tiles[(u64)ty * rev->tilesX + tx];
+         auto r = _revisionTileRect(rev, tx, ty);
+         if (_historyTileMatches(tile, target, r)) {
+            continue;
+         }
+
+         for (i32 y = 0; y < r.h; ++y) {
+            _historyTileRow(tile, y, r.w, row);
+            _texWriteRow(target, r.x, r.y + y, r.w, row);
+         }
+         _textureMarkDirty(target, r);
+      }
+   }
+}
+
+bool egaHistoryUndo(EGAHistory *self, EGATexture *target) {
+   if (self->position == 0) {
+      return false;
+   }
+
+   --self->position;
+   _historyRestore(self, target);
+   return true;
+}
+bool egaHistoryRedo(EGAHistory *self, EGATexture *target) {
+   if (self->position + 1 >= self->revisions.size()) {
+      return false;
+   }
+
+   ++self->position;
+   _historyRestore(self, target);
+   return true;
+}
+
+u32 egaHistoryGetCount(EGAHistory const *self) { return (u32)self->revisions.size(); }
+u32 egaHistoryGetPosition(EGAHistory const *self) { return self->position; }
+u64 egaHistoryGetMemorySize(EGAHistory const *self) { return sizeof(EGAHistory) + self->memory; }
+
+#pragma endregion
+
+#pragma region FONTS
+
+/*
+The sheet gets parsed once into 1-bit glyph rows and each font is those rows pre-expanded to
+8 colored bytes, so stamping a glyph row is one 8-byte store or a masked blend for transparent backgrounds
+*/
+
+// background slot for EGA_ALPHA, only foreground pixels get written
+#define EGA_FONT_BG_ALPHA EGA_PALETTE_COLORS
+
+struct EGAFontFactory {
+   byte glyphs[EGA_FONT_GLYPHS][EGA_FONT_GLYPH_HEIGHT];  // bit 7 is the leftmost pixel
+   u64 masks[EGA_FONT_GLYPHS][EGA_FONT_GLYPH_HEIGHT];    // 0xFF bytes where the glyph is foreground
+   EGAFont *fonts[EGA_PALETTE_COLORS + 1][EGA_PALETTE_COLORS]; // built on first request
+};
+
+struct EGAFont {
+   EGAFontFactory *factory;
+   bool transparent;
+   u64 rows[EGA_FONT_GLYPHS][EGA_FONT_GLYPH_HEIGHT];     // colored pixel bytes, 0 outside the mask if transparent
+};
+
+static u64 _fontExpandRow(byte bits, byte on, byte off) {
+   byte px[EGA_FONT_GLYPH_WIDTH];
+   for (u32 x = 0; x < EGA_FONT_GLYPH_WIDTH; ++x) {
+      px[x] = (bits & (0x80 >> x)) ? on : off;
+   }
+
+   u64 out;
+   memcpy(&out, px, sizeof(out));
+   return out;
+}
+
+EGAFontFactory *egaFontFactoryCreate(EGATexture *font) {
+   if (font->w != EGA_FONT_GLYPH_WIDTH * 32 || font->h != EGA_FONT_GLYPH_HEIGHT * 8) {
+      return nullptr;
+   }
+
+   auto self = new EGAFontFactory();
+   for (u32 c = 0; c < EGA_FONT_GLYPHS; ++c) {
+      u32 sx = (c % 32) * EGA_FONT_GLYPH_WIDTH;
+      u32 sy = (c / 32) * EGA_FONT_GLYPH_HEIGHT;
+
+      for (u32 y = 0; y < EGA_FONT_GLYPH_HEIGHT; ++y) {
+         byte src[EGA_FONT_GLYPH_WIDTH];
+         _texReadRow(font, sx, sy + y, EGA_FONT_GLYPH_WIDTH, src);
+
+         byte bits = 0;
+         for (u32 x = 0; x < EGA_FONT_GLYPH_WIDTH; ++x) {
+            if (src[x] && src[x] != EGA_ALPHA) {
+               bits |= 0x80 >> x;
+            }
+         }
+
+         self->glyphs[c][y] = bits;
+         self->masks[c][y] = _fontExpandRow(bits, 0xFF, 0);
+      }
+   }
+
+   return self;
+}
+void egaFontFactoryDestroy(EGAFontFactory *self) {
+   for (auto &bgFonts : self->fonts) {
+      for (auto font : bgFonts) {
+         delete font;
+      }
+   }
+   delete self;
+}
+EGAFont *egaFontFactoryGetFont(EGAFontFactory *self, EGAPColor bgColor, EGAPColor fgColor) {
+   if (fgColor >= EGA_PALETTE_COLORS || (bgColor >= EGA_PALETTE_COLORS && bgColor != EGA_ALPHA)) {
+      return nullptr;
+   }
+
+   bool transparent = bgColor == EGA_ALPHA;
+   auto &font = self->fonts[transparent ? EGA_FONT_BG_ALPHA : bgColor][fgColor];
+   if (!font) {
+      font = new EGAFont();
+      font->factory = self;
+      font->transparent = transparent;
+      for (u32 c = 0; c < EGA_FONT_GLYPHS; ++c) {
+         for (u32 y = 0; y < EGA_FONT_GLYPH_HEIGHT; ++y) {
+            font->rows[c][y] = _fontExpandRow(self->glyphs[c][y], fgColor, transparent ? 0 : bgColor);
+         }
+      }
+   }
+
+   return font;
+}
+
+#pragma endregion
+
+void egaClear(EGATexture *target, EGAPColor color, EGARegion *vp) {
+   if (!vp) {
+      //fast clear
+      if (target->tiled) {
+         _tiledFill(target, color);
+      }
+      else {
+         memset(target->pixelData, color, target->pixelCount);
+      }
+      _textureMarkAllDirty(target);
+   }
+   else {
+      //region clear is just a rect render on the vp
+      egaRenderRect(target, *vp, color);
+   }
+}
+void egaClearAlpha(EGATexture *target) {
+   if (target->tiled) {
+      _tiledFill(target, EGA_ALPHA);
+   }
+   else {
+      memset(target->pixelData, EGA_ALPHA, target->pixelCount);
+   }
+   _textureMarkAllDirty(target);
+}
+
+static void _renderSpansEX(EGATexture *dest, EGATexture *src, Recti const& srcRect, Int2 const& destPos) {
+   if (src->dirty & Tex_SPANS_DIRTY) {
+      _compileSpans(src);
+   }
+
+   i32 srcRight = srcRect.x + srcRect.w;
+   // offset back by the source x so span coords index both rows directly
+   byte *destPixels = dest->pixelData + ((i64)destPos.y * dest->w + destPos.x) - srcRect.x;
+
+   for (int y = srcRect.y; y < srcRect.y + srcRect.h; ++y) {
+      byte *srcSL = src->pixelData + y * src->w;
+      auto span = src->spans.data() + src->spanRows[y];
+      auto end = src->spans.data() + src->spanRows[y + 1];
+
+      for (; span != end && (i32)span->x < srcRight; ++span) {
+         i32 x1 = MAX((i32)span->x, srcRect.x);
+         i32 x2 = MIN((i32)(span->x + span->len), srcRight);
+         if (x1 < x2) {
+            memcpy(destPixels + x1, srcSL + x1, x2 - x1);
+         }
+      }
+
+      destPixels += dest->w;
+   }
+}
+
+// copies the opaque pixels of srcRect to destPos, both already clipped
+static void _renderTextureEX(EGATexture *dest, EGATexture *src, Recti const& srcRect, Int2 const& destPos) {
+   if (dest->tiled || src->tiled) {
+      // through a row buffer, missing source tiles read transparent and never allocate dest tiles
+      std::vector<byte> row(srcRect.w);
+      for (i32 y = 0; y < srcRect.h; ++y) {
+         _texReadRow(src, srcRect.x, srcRect.y + y, srcRect.w, row.data());
+         _texBlendRow(dest, destPos.x, destPos.y + y, srcRect.w, row.data());
+      }
+      return;
+   }
+
+   if (src->compiled) {
+      _renderSpansEX(dest, src, srcRect, destPos);
+      return;
+   }
+
+   byte *srcPixels = src->pixelData + (srcRect.y * src->w + srcRect.x);
    byte *destPixels = dest->pixelData + (destPos.y * dest->w + destPos.x);
 
-   for (int y = 0; y < srcRect.h; ++y) {
-      byte *srcSL = srcPixels;
-      byte *destSL = destPixels;
+   for (int y = 0; y < srcRect.h; ++y) {
+      byte *srcSL = srcPixels;
+      byte *destSL = destPixels;
+
+      for (int x = 0; x < srcRect.w; ++x) {
+         if (*srcSL < EGA_PALETTE_COLORS) {
+            *destSL = *srcSL;
+         }
+         ++srcSL; ++destSL;
+      }
+      srcPixels += src->w;
+      destPixels += dest->w;
+   }
+}
+
+// uv gets clamped to the source, returns false if nothing was drawn, otherwise drawn is the dest rect it touched
+static bool _blitTexture(EGATexture *target, Int2 pos, EGATexture *tex, Recti uv, EGARegion const &vp, Recti &drawn, i32 bandTop = 0, i32 bandBottom = INT32_MAX) {
+   // keep uv inside the source, shifting pos along with it
+   if (uv.x < 0) { pos.x -= uv.x; uv.w += uv.x; uv.x = 0; }
+   if (uv.y < 0) { pos.y -= uv.y; uv.h += uv.y; uv.y = 0; }
+   uv.w = MIN(uv.w, (i32)tex->w - uv.x);
+   uv.h = MIN(uv.h, (i32)tex->h - uv.y);
+
+   if (!_clipBlit(vp, target->w, target->h, uv, pos, bandTop, bandBottom)) {
+      return false;
+   }
+
+   _renderTextureEX(target, tex, uv, pos);
+   drawn = { pos.x, pos.y, uv.w, uv.h };
+   return true;
+}
+
+// one kernel pass over the region, dirty covers the rows that actually changed
+static void _remapRegion(EGATexture *target, EGARemapLUT const &lut, EGARegion const *vp) {
+   EGARaster r;
+   if (!_rasterBegin(r, target, vp)) {
+      return;
+   }
+
+   // texture coords from here on
+   i32 left = r.left + r.ox, right = r.right + r.ox;
+   i32 top = r.top + r.oy, bottom = r.bottom + r.oy;
+   i32 changedTop = INT32_MAX, changedBottom = INT32_MIN;
+
+   auto remapRow = [&](byte *row, u32 count, i32 y) {
+      if (g_remapKernel(row, count, lut)) {
+         changedTop = MIN(changedTop, y);
+         changedBottom = MAX(changedBottom, y);
+      }
+   };
+
+   if (!target->tiled) {
+      for (i32 y = top; y < bottom; ++y) {
+         remapRow(target->pixelData + (u64)y * target->w + left, right - left, y);
+      }
+   }
+   else {
+      // a tile at a time, missing tiles only matter when transparency gets replaced
+      auto remapTile = [&](byte *tile, u32 tx, u32 ty) {
+         i32 ox = tx << EGA_TILE_SHIFT, oy = ty << EGA_TILE_SHIFT;
+         i32 x1 = MAX(left, ox), x2 = MIN(right, ox + EGA_TILE_SIZE);
+         i32 y1 = MAX(top, oy), y2 = MIN(bottom, oy + EGA_TILE_SIZE);
+         for (i32 y = y1; y < y2; ++y) {
+            remapRow(tile + ((y - oy) << EGA_TILE_SHIFT) + (x1 - ox), x2 - x1, y);
+         }
+      };
+
+      auto &g = target->grid;
+      if (lut.alphaReplace && lut.alpha < EGA_PALETTE_COLORS) {
+         for (u32 ty = top >> EGA_TILE_SHIFT; ty <= (u32)(bottom - 1) >> EGA_TILE_SHIFT; ++ty) {
+            for (u32 tx = left >> EGA_TILE_SHIFT; tx <= (u32)(right - 1) >> EGA_TILE_SHIFT; ++tx) {
+               auto &tile = _gridSlot(g, tx, ty);
+               if (!tile) {
+                  tile = _tileAlloc();
+               }
+               remapTile(tile, tx, ty);
+            }
+         }
+      }
+      else {
+         _gridEach(g, [&](byte *&tile, u32 tx, u32 ty) {
+            i32 ox = tx << EGA_TILE_SHIFT, oy = ty << EGA_TILE_SHIFT;
+            if (ox < right && ox + EGA_TILE_SIZE > left && oy < bottom && oy + EGA_TILE_SIZE > top) {
+               remapTile(tile, tx, ty);
+            }
+         });
+      }
+   }
+
+   if (changedTop <= changedBottom) {
+      _textureMarkDirty(target, { left, changedTop, right - left, changedBottom - changedTop + 1 });
+   }
+}
+
+void egaRemapIndices(EGATexture *target, EGAPColor const lut[EGA_PALETTE_COLORS], EGARegion *vp) {
+   EGARemapLUT remap;
+   memcpy(remap.map, lut, sizeof(remap.map));
+   _remapRegion(target, remap, vp);
+}
+
+void egaColorReplace(EGATexture *target, EGAPColor oldColor, EGAPColor newColor) {
+   if (oldColor == newColor) {
+      return;
+   }
+
+   EGARemapLUT remap;
+   for (byte i = 0; i < EGA_PALETTE_COLORS; ++i) {
+      remap.map[i] = i;
+   }
+
+   if (oldColor < EGA_PALETTE_COLORS) {
+      remap.map[oldColor] = newColor;
+   }
+   else {
+      remap.alphaReplace = true;
+      remap.alpha = newColor;
+   }
+
+   _remapRegion(target, remap, nullptr);
+}
+
+// a filled span on row y - dy, row y is next to be scanned
+struct EGAFillSpan {
+   i32 x1, x2, y, dy;
+};
+
+// any non-palette byte counts as transparent
+static bool _fillSame(byte a, byte b) {
+   return a == b || (a >= EGA_PALETTE_COLORS && b >= EGA_PALETTE_COLORS);
+}
+
+Recti egaFloodFill(EGATexture *target, Int2 pos, EGAPColor color, bool eightWay, EGARegion *vp) {
+   Recti filled = { pos.x, pos.y, 0, 0 };
+
+   EGARaster r;
+   if (!_rasterBegin(r, target, vp) ||
+      pos.x < r.left || pos.x >= r.right || pos.y < r.top || pos.y >= r.bottom) {
+      return filled;
+   }
+
+   byte old = *_texReadPtr(target, pos.x + r.ox, pos.y + r.oy);
+   if (_fillSame(old, color)) {
+      return filled; // also what keeps filled pixels from matching again
+   }
+
+   // linear targets read straight out of the row
+   byte const *row = nullptr;
+   i32 rowY = INT32_MIN;
+   auto matches = [&](i32 x, i32 y) {
+      if (target->tiled) {
+         return _fillSame(*_texReadPtr(target, x + r.ox, y + r.oy), old);
+      }
+      if (y != rowY) {
+         row = _rasterRow(r, y);
+         rowY = y;
+      }
+      return _fillSame(row[x], old);
+   };
+   i32 reach = eightWay ? 1 : 0;
+
+   i32 x1 = pos.x, x2 = pos.x;
+   while (x1 > r.left && matches(x1 - 1, pos.y)) { --x1; }
+   while (x2 + 1 < r.right && matches(x2 + 1, pos.y)) { ++x2; }
+   _rasterSpan(r, x1, x2, pos.y, color);
+
+   std::vector<EGAFillSpan> stack;
+   stack.push_back({ x1, x2, pos.y + 1, 1 });
+   stack.push_back({ x1, x2, pos.y - 1, -1 });
+
+   while (!stack.empty()) {
+      auto span = stack.back();
+      stack.pop_back();
+
+      if (span.y < r.top || span.y >= r.bottom) {
+         continue;
+      }
+
+      i32 x = MAX(span.x1 - reach, r.left);
+      i32 end = MIN(span.x2 + reach, r.right - 1);
+      while (x <= end) {
+         if (!matches(x, span.y)) {
+            ++x;
+            continue;
+         }
+
+         // runs can spill out past the span above them in either direction
+         i32 runL = x, runR = x;
+         while (runL > r.left && matches(runL - 1, span.y)) { --runL; }
+         while (runR + 1 < r.right && matches(runR + 1, span.y)) { ++runR; }
+         _rasterSpan(r, runL, runR, span.y, color);
+
+         stack.push_back({ runL, runR, span.y + span.dy, span.dy });
+
+         // the parent row only needs another look where this run sticks out past its parent
+         if (runL < span.x1 || runR > span.x2) {
+            stack.push_back({ runL, runR, span.y - span.dy, -span.dy });
+         }
+
+         x = runR + 2;
+      }
+   }
+
+   filled = { r.minX, r.minY, r.maxX - r.minX + 1, r.maxY - r.minY + 1 };
+   _rasterEnd(r);
+   return filled;
+}
+
+void egaRenderTexture(EGATexture *target, Int2 pos, EGATexture *tex, EGARegion *vp) {
+   egaRenderTexturePartial(target, pos, tex, { 0, 0, (i32)tex->w, (i32)tex->h }, vp);
+}
+void egaRenderTexturePartial(EGATexture *target, Int2 pos, EGATexture *tex, Recti uv, EGARegion *vp) {
+   if (!vp) { vp = &target->fullRegion; }
+
+   Recti drawn;
+   if (_blitTexture(target, pos, tex, uv, *vp, drawn)) {
+      _textureMarkDirty(target, drawn);
+   }
+}
+void egaRenderPoint(EGATexture *target, Int2 pos, EGAPColor color, EGARegion *vp) {
+   EGARaster r;
+   if (_rasterBegin(r, target, vp)) {
+      _rasterPoint(r, pos.x, pos.y, color);
+      _rasterEnd(r);
+   }
+}
+void egaRenderPoints(EGATexture *target, Int2 const *points, u32 count, EGAPColor color, EGARegion *vp) {
+   EGARaster r;
+   if (_rasterBegin(r, target, vp)) {
+      for (u32 i = 0; i < count; ++i) {
+         _rasterPoint(r, points[i].x, points[i].y, color);
+      }
+      _rasterEnd(r);
+   }
+}
+
+enum Outcode_ {
+   Outcode_LEFT = (1 << 0),
+   Outcode_RIGHT = (1 << 1),
+   Outcode_TOP = (1 << 2),
+   Outcode_BOTTOM = (1 << 3)
+};
+
+static byte _rasterOutcode(EGARaster const &r, Int2 p) {
+   byte out = 0;
+   if (p.x < r.left) { out |= Outcode_LEFT; }
+   else if (p.x >= r.right) { out |= Outcode_RIGHT; }
+   if (p.y < r.top) { out |= Outcode_TOP; }
+   else if (p.y >= r.bottom) { out |= Outcode_BOTTOM; }
+   return out;
+}
+
+// n >= 0, d > 0
+static i64 _ceilDiv(i64 n, i64 d) {
+   return (n + d - 1) / d;
+}
+
+/*
+Integer bresenham, always stepping forward along the major axis so a->b and b->a hit the same pixels
+At step k the minor offset is round(k * minor / major) with ties rounding up, tracked with
+e = (2*k*minor + major) mod 2*major
+
+Clipping happens up front: outcodes throw out lines fully to one side, otherwise the clip edges get
+solved for the first and last step inside, so a clipped line lands on exactly the pixels the unclipped one would
+*/
+static void _rasterLine(EGARaster &r, Int2 a, Int2 b, EGAPColor color) {
+   i32 dx = abs(b.x - a.x), dy = abs(b.y - a.y);
+   if (!dx && !dy) {
+      _rasterPoint(r, a.x, a.y, color);
+      return;
+   }
+
+   byte codeA = _rasterOutcode(r, a), codeB = _rasterOutcode(r, b);
+   if (codeA & codeB) {
+      return;
+   }
+
+   bool xMajor = dx > dy;
+   if (xMajor ? a.x > b.x : a.y > b.y) {
+      std::swap(a, b);
+   }
+
+   i64 major = xMajor ? dx : dy, minor = xMajor ? dy : dx;
+   i32 majorStart = xMajor ? a.x : a.y;
+   i32 minorStart = xMajor ? a.y : a.x;
+   i32 minorDir = xMajor ? SIGN(b.y - a.y) : SIGN(b.x - a.x);
+
+   i64 k0 = 0, k1 = major;
+   if (codeA | codeB) {
+      i32 majorLo = xMajor ? r.left : r.top, majorHi = (xMajor ? r.right : r.bottom) - 1;
+      i32 minorLo = xMajor ? r.top : r.left, minorHi = (xMajor ? r.bottom : r.right) - 1;
+
+      k0 = MAX(k0, (i64)majorLo - majorStart);
+      k1 = MIN(k1, (i64)majorHi - majorStart);
+
+      // range of minor offsets that stay inside, flipped if we step negative
+      i64 mLo = minorDir < 0 ? (i64)minorStart - minorHi : (i64)minorLo - minorStart;
+      i64 mHi = minorDir < 0 ? (i64)minorStart - minorLo : (i64)minorHi - minorStart;
+      if (mHi < 0 || mLo > minor) {
+         return;
+      }
+
+      if (minor) {
+         if (mLo > 0) { k0 = MAX(k0, _ceilDiv(2 * major * mLo - major, 2 * minor)); }
+         if (mHi < minor) { k1 = MIN(k1, _ceilDiv(2 * major * (mHi + 1) - major, 2 * minor) - 1); }
+      }
 
-      for (int x = 0; x < srcRect.w; ++x) {
-         if (*srcSL < EGA_PALETTE_COLORS) {
-            *destSL = *srcSL;
+      if (k0 > k1) {
+         return;
+      }
+   }
+
+   i64 twoMajor = 2 * major, twoMinor = 2 * minor;
+   i64 num = twoMinor * k0 + major;
+   i32 m = (i32)(num / twoMajor);
+   i64 e = num % twoMajor;
+
+   if (xMajor) {
+      // consecutive steps on the same row go out as one span
+      i32 x = majorStart + (i32)k0, xEnd = majorStart + (i32)k1;
+      i32 y = minorStart + minorDir * m;
+      i32 runStart = x;
+
+      for (; x <= xEnd; ++x) {
+         e += twoMinor;
+         if (e >= twoMajor) {
+            e -= twoMajor;
+            _texFill(r.target, runStart + r.ox, y + r.oy, x - runStart + 1, color);
+            _rasterTouch(r, runStart, y, x, y);
+
+            y += minorDir;
+            runStart = x + 1;
          }
-         ++srcSL; ++destSL;
       }
-      srcPixels += src->w;
-      destPixels += dest->w;
+
+      if (runStart <= xEnd) {
+         _texFill(r.target, runStart + r.ox, y + r.oy, xEnd - runStart + 1, color);
+         _rasterTouch(r, runStart, y, xEnd, y);
+      }
+   }
+   else {
+      i32 y = majorStart + (i32)k0, yEnd = majorStart + (i32)k1;
+      i32 x = minorStart + minorDir * m;
+      i32 xLast = minorStart + minorDir * (i32)((twoMinor * k1 + major) / twoMajor);
+      _rasterTouch(r, MIN(x, xLast), y, MAX(x, xLast), yEnd);
+
+      if (r.target->tiled) {
+         for (; y <= yEnd; ++y) {
+            _texSetPixel(r.target, x + r.ox, y + r.oy, color);
+
+            e += twoMinor;
+            if (e >= twoMajor) {
+               e -= twoMajor;
+               x += minorDir;
+            }
+         }
+         return;
+      }
+
+      byte *dest = _rasterRow(r, y);
+
+      for (; y <= yEnd; ++y) {
+         dest[x] = color;
+         dest += r.target->w;
+
+         e += twoMinor;
+         if (e >= twoMajor) {
+            e -= twoMajor;
+            x += minorDir;
+         }
+      }
+
+   }
+}
+void egaRenderLine(EGATexture *target, Int2 pos1, Int2 pos2, EGAPColor color, EGARegion *vp) {
+   EGARaster r;
+   if (_rasterBegin(r, target, vp)) {
+      _rasterLine(r, pos1, pos2, color);
+      _rasterEnd(r);
+   }
+}
+void egaRenderLines(EGATexture *target, Int2 const *segments, u32 segmentCount, EGAPColor color, EGARegion *vp) {
+   EGARaster r;
+   if (_rasterBegin(r, target, vp)) {
+      for (u32 i = 0; i < segmentCount; ++i) {
+         _rasterLine(r, segments[i * 2], segments[i * 2 + 1], color);
+      }
+      _rasterEnd(r);
    }
-   dest->dirty = Tex_ALL_DIRTY;
 }
+void egaRenderPolyline(EGATexture *target, Int2 const *points, u32 count, EGAPColor color, EGARegion *vp) {
+   if (count == 1) {
+      egaRenderPoint(target, points[0], color, vp);
+      return;
+   }
 
-void egaColorReplace(EGATexture *target, EGAPColor oldColor, EGAPColor newColor) {
-   for (u32 i = 0; i < target->pixelCount; ++i) {
-      if (target->pixelData[i] == oldColor) {
-         target->pixelData[i] = newColor;
+   EGARaster r;
+   if (_rasterBegin(r, target, vp)) {
+      for (u32 i = 1; i < count; ++i) {
+         _rasterLine(r, points[i - 1], points[i], color);
       }
+      _rasterEnd(r);
    }
-   target->dirty = Tex_ALL_DIRTY;
 }
+static void _rasterLineRect(EGARaster &raster, Recti r, EGAPColor color) {
+   if (r.w <= 0 || r.h <= 0) {
+      return;
+   }
 
-void egaRenderTexture(EGATexture *target, Int2 pos, EGATexture *tex, EGARegion *vp) {
-   if (!vp) { vp = &target->fullRegion; }
+   i32 right = r.x + r.w - 1, bottom = r.y + r.h - 1;
+   _rasterSpan(raster, r.x, right, r.y, color);
+   _rasterSpan(raster, r.x, right, bottom, color);
+   _rasterColumn(raster, r.x, r.y + 1, bottom - 1, color);
+   _rasterColumn(raster, right, r.y + 1, bottom - 1, color);
+}
+void egaRenderLineRect(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp) {
+   EGARaster raster;
+   if (_rasterBegin(raster, target, vp)) {
+      _rasterLineRect(raster, r, color);
+      _rasterEnd(raster);
+   }
+}
+void egaRenderRect(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp) {
+   EGARaster raster;
+   if (_rasterBegin(raster, target, vp)) {
+      _rasterFill(raster, r.x, r.y, r.x + r.w - 1, r.y + r.h - 1, color);
+      _rasterEnd(raster);
+   }
+}
+
+/*
+Ellipses are the integer midpoint walk over the bounding rect (so even sizes work without half-pixel centers)
+it only walks one quadrant and every finished row goes out as mirrored spans on both halves
+outline rows are the run of pixels the walk stepped through on that row, filled rows are the whole width
+*/
 
-   Int2 offsetPos = { pos.x + vp->x, pos.y + vp->y };
+// left side is outer to inner, right side is mirrored around xSum
+static void _rasterEllipseRow(EGARaster &r, i32 outer, i32 inner, i32 xSum, i32 yTop, i32 yBottom, bool fill, EGAPColor color) {
+   i32 right = xSum - outer;
+
+   if (fill || xSum - inner <= inner + 1) {
+      _rasterSpan(r, outer, right, yTop, color);
+      if (yBottom != yTop) {
+         _rasterSpan(r, outer, right, yBottom, color);
+      }
+   }
+   else {
+      _rasterSpan(r, outer, inner, yTop, color);
+      _rasterSpan(r, xSum - inner, right, yTop, color);
+      if (yBottom != yTop) {
+         _rasterSpan(r, outer, inner, yBottom, color);
+         _rasterSpan(r, xSum - inner, right, yBottom, color);
+      }
+   }
+}
 
-   if (offsetPos.x >= vp->w || offsetPos.y >= vp->h ||
-      offsetPos.x < -(i32)tex->w || offsetPos.y < -(i32)tex->h) {
-      //outside bounds, return
+static void _rasterEllipse(EGARaster &r, Recti rect, bool fill, EGAPColor color) {
+   if (rect.w <= 0 || rect.h <= 0) {
       return;
    }
 
-   Recti srcRect = { 0 };
-   srcRect.x = offsetPos.x < 0 ? -offsetPos.x : 0;
-   srcRect.y = offsetPos.y < 0 ? -offsetPos.y : 0;
-   srcRect.w = MIN(vp->w, MIN(vp->w - offsetPos.x, tex->w - srcRect.x));
-   srcRect.h = MIN(vp->h, MIN(vp->h - offsetPos.y, tex->h - srcRect.y));
+   i64 a = rect.w - 1, b = rect.h - 1, b1 = b & 1;
+   i64 dx = 4 * (1 - a) * b * b, dy = 4 * (b1 + 1) * a * a;
+   i64 err = dx + dy + b1 * a * a;
+   i64 a8 = 8 * a * a, b8 = 8 * b * b;
+
+   i32 x0 = rect.x, x1 = rect.x + rect.w - 1;
+   i32 xSum = x0 + x1;
+
+   // walk outward from the middle row(s), yTop and yBottom are the same row for odd heights
+   i32 yTop = rect.y + (i32)((b + 1) / 2 - b1), yBottom = yTop + (i32)b1;
+   i32 outer = x0, inner = x0;
+   bool open = false;
+
+   do {
+      inner = x0;
+      open = true;
+
+      i64 e2 = 2 * err;
+      bool stepY = e2 <= dy;
+      if (stepY) {
+         _rasterEllipseRow(r, outer, inner, xSum, yTop, yBottom, fill, color);
+         --yTop; ++yBottom;
+         err += dy += a8;
+         open = false;
+      }
+      if (e2 >= dx || 2 * err > dy) {
+         ++x0; --x1;
+         err += dx += b8;
+      }
+      if (stepY) {
+         outer = x0;
+      }
+   } while (x0 <= x1);
 
-   Int2 destPos = { 0 };
-   destPos.x = offsetPos.x < 0 ? 0 : pos.x;
-   destPos.y = offsetPos.y < 0 ? 0 : pos.y;
+   // very flat ellipses run out of x before reaching the tips
+   while (yBottom - yTop <= b) {
+      if (!open) {
+         outer = x0 - 1;
+      }
+      _rasterEllipseRow(r, outer, x0 - 1, xSum, yTop, yBottom, fill, color);
+      --yTop; ++yBottom;
+      open = false;
+   }
 
-   _renderTextureEX(target, tex, srcRect, destPos);
+   if (open) {
+      _rasterEllipseRow(r, outer, inner, xSum, yTop, yBottom, fill, color);
+   }
+}
+
+static Recti _circleRect(Int2 pos, int radius) {
+   return { pos.x - radius, pos.y - radius, radius * 2 + 1, radius * 2 + 1 };
+}
+
+// QuickBASIC CIRCLE: radius is along x when aspect < 1, along y otherwise
+static Recti _ellipseQBRect(Int2 pos, int radius, double aspect) {
+   if (radius < 0) {
+      return { 0, 0, 0, 0 };
+   }
+
+   aspect = fabs(aspect);
+   i32 rx = radius, ry = radius;
+   if (aspect < 1.0) {
+      ry = (i32)(radius * aspect + 0.5);
+   }
+   else {
+      rx = (i32)(radius / aspect + 0.5);
+   }
+
+   return { pos.x - rx, pos.y - ry, rx * 2 + 1, ry * 2 + 1 };
+}
+
+static void _renderEllipse(EGATexture *target, Recti r, bool fill, EGAPColor color, EGARegion *vp) {
+   EGARaster raster;
+   if (_rasterBegin(raster, target, vp)) {
+      _rasterEllipse(raster, r, fill, color);
+      _rasterEnd(raster);
+   }
 }
-void egaRenderTexturePartial(EGATexture *target, Int2 pos, EGATexture *tex, Recti uv, EGARegion *vp) {
-   if (!vp) { vp = &target->fullRegion; }
 
-   Int2 offsetPos = { pos.x + vp->x, pos.y + vp->y };
+void egaRenderCircle(EGATexture *target, Int2 pos, int radius, EGAPColor color, EGARegion *vp) {
+   _renderEllipse(target, _circleRect(pos, radius), false, color, vp);
+}
+void egaRenderCircleFilled(EGATexture *target, Int2 pos, int radius, EGAPColor color, EGARegion *vp) {
+   _renderEllipse(target, _circleRect(pos, radius), true, color, vp);
+}
+void egaRenderEllipse(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp) {
+   _renderEllipse(target, r, false, color, vp);
+}
+void egaRenderEllipseFilled(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp) {
+   _renderEllipse(target, r, true, color, vp);
+}
+void egaRenderEllipseQB(EGATexture *target, Int2 pos, int radius, double aspect, EGAPColor color, EGARegion *vp) {
+   _renderEllipse(target, _ellipseQBRect(pos, radius, aspect), false, color, vp);
+}
+void egaRenderEllipseQBFilled(EGATexture *target, Int2 pos, int radius, double aspect, EGAPColor color, EGARegion *vp) {
+   _renderEllipse(target, _ellipseQBRect(pos, radius, aspect), true, color, vp);
+}
 
-   if (offsetPos.x >= vp->w || offsetPos.y >= vp->h ||
-      offsetPos.x < -(i32)uv.w || offsetPos.y < -(i32)uv.h) {
-      //outside bounds, return
+static void _rasterGlyph(EGARaster &r, EGAFont const *font, byte c, i32 x, i32 y) {
+   if (x + EGA_FONT_GLYPH_WIDTH <= r.left || x >= r.right || y + EGA_FONT_GLYPH_HEIGHT <= r.top || y >= r.bottom) {
       return;
    }
 
-   Recti srcRect = { 0 };
-   srcRect.x = pos.x < 0 ? uv.x - pos.x : uv.x;
-   srcRect.y = pos.y < 0 ? uv.y - pos.y : uv.y;
+   u64 const *rows = font->rows[c];
+   u64 const *masks = font->factory->masks[c];
+   i32 y0 = MAX(0, r.top - y), y1 = MIN(EGA_FONT_GLYPH_HEIGHT, r.bottom - y);
+   i32 x0 = MAX(0, r.left - x), x1 = MIN(EGA_FONT_GLYPH_WIDTH, r.right - x);
+
+   if (!r.target->tiled && x0 == 0 && x1 == EGA_FONT_GLYPH_WIDTH) {
+      byte *dest = _rasterRow(r, y + y0) + x;
+      for (i32 gy = y0; gy < y1; ++gy) {
+         if (font->transparent) {
+            u64 px;
+            memcpy(&px, dest, sizeof(px));
+            px = (px & ~masks[gy]) | rows[gy];
+            memcpy(dest, &px, sizeof(px));
+         }
+         else {
+            memcpy(dest, &rows[gy], sizeof(u64));
+         }
+         dest += r.target->w;
+      }
+   }
+   else {
+      // straddling the clip edge or a tile edge, read-modify-write just the visible bytes
+      u32 tx = x + x0 + r.ox, len = x1 - x0;
+      for (i32 gy = y0; gy < y1; ++gy) {
+         byte px[EGA_FONT_GLYPH_WIDTH], mask[EGA_FONT_GLYPH_WIDTH], dest[EGA_FONT_GLYPH_WIDTH];
+         memcpy(px, &rows[gy], sizeof(px));
+         memcpy(mask, &masks[gy], sizeof(mask));
+
+         u32 ty = y + gy + r.oy;
+         _texReadRow(r.target, tx, ty, len, dest);
+         for (i32 gx = x0; gx < x1; ++gx) {
+            if (!font->transparent || mask[gx]) {
+               dest[gx - x0] = px[gx];
+            }
+         }
+         _texWriteRow(r.target, tx, ty, len, dest);
+      }
+   }
 
-   srcRect.w = MIN(vp->w, MIN(uv.w, uv.w - (srcRect.x - uv.x) ));
-   srcRect.h = MIN(vp->h, MIN(uv.h, uv.h - (srcRect.y - uv.y)));
+   _rasterTouch(r, x + x0, y + y0, x + x1 - 1, y + y1 - 1);
+}
 
-   Int2 destPos = { 0 };
-   destPos.x = offsetPos.x < 0 ? 0 : pos.x;
-   destPos.y = offsetPos.y < 0 ? 0 : pos.y;
+static void _rasterText(EGARaster &r, const char *text, Int2 pos, EGAFont const *font, bool skipSpaces) {
+   i32 x = pos.x, y = pos.y;
+   for (; *text; ++text) {
+      if (*text == '\n') {
+         x = pos.x;
+         y += EGA_FONT_GLYPH_HEIGHT;
+         continue;
+      }
 
-   _renderTextureEX(target, tex, srcRect, destPos);
+      if (!skipSpaces || *text != ' ') {
+         _rasterGlyph(r, font, (byte)*text, x, y);
+      }
+      x += EGA_FONT_GLYPH_WIDTH;
+   }
 }
-void egaRenderPoint(EGATexture *target, Int2 pos, EGAPColor color, EGARegion *vp) {
-   if (!vp) { vp = &target->fullRegion; }
 
-   if (pos.x >= vp->w || pos.y >= vp->h) {
+static void _renderText(EGATexture *target, const char *text, Int2 pos, EGAFont *font, bool skipSpaces) {
+   if (!font || !text) {
       return;
    }
 
-   pos.x += vp->x;
-   pos.y += vp->y;
+   EGARaster r;
+   if (_rasterBegin(r, target, nullptr)) {
+      _rasterText(r, text, pos, font, skipSpaces);
+      _rasterEnd(r);
+   }
+}
 
-   if (pos.x >= target->w || pos.y >= target->h ||
-         pos.x < 0 || pos.y < 0) {
+void egaRenderTextSingleChar(EGATexture *target, const char c, Int2 pos, EGAFont *font, int spaces) {
+   if (!font) {
       return;
    }
 
-   target->pixelData[pos.y * target->w + pos.x] = color;
-   target->dirty = Tex_ALL_DIRTY;
+   EGARaster r;
+   if (_rasterBegin(r, target, nullptr)) {
+      _rasterGlyph(r, font, (byte)c, pos.x + spaces * EGA_FONT_GLYPH_WIDTH, pos.y);
+      _rasterEnd(r);
+   }
+}
+void egaRenderText(EGATexture *target, const char *text, Int2 pos, EGAFont *font) {
+   _renderText(target, text, pos, font, false);
+}
+void egaRenderTextWithoutSpaces(EGATexture *target, const char *text, Int2 pos, EGAFont *font) {
+   _renderText(target, text, pos, font, true);
 }
-void egaRenderLine(EGATexture *target, Int2 pos1, Int2 pos2, EGAPColor color, EGARegion *vp) {
-   int dx = abs(pos2.x - pos1.x);
-   int dy = abs(pos2.y - pos1.y);
-   int x0, x1, y0, y1;
-   float x, y, slope;
 
-   //len=0
-   if (!dx && !dy) {
-      //TODO: not sure if i want to do this? line size (0,0) draws a point?
-      egaRenderPoint(target, pos1, color, vp);
+#pragma region PALETTE ANIMATION
+
+/*
+The animator owns a base palette, fades change base slots over time and cycles rotate ranges of slots on top of that
+each update writes base + fades + cycles into the output palette, which is what gets decoded with
+Decode only redoes pixels using slots that changed so cycling a range costs about what the range covers on screen
+*/
+
+struct EGAPaletteCycle {
+   byte first, last;
+   f32 rate;
+   f64 time = 0.0;
+};
+
+struct EGAPaletteFade {
+   bool active = false;
+   EGAColor from, to;
+   f32 duration, time;
+};
+
+struct EGAPaletteAnimator {
+   EGAPalette base;
+   std::vector<EGAPaletteCycle> cycles;
+   EGAPaletteFade fades[EGA_PALETTE_COLORS];
+};
+
+// nearest of the 64 EGA colors, fades can only step through those
+static EGAColor _nearestEGAColor(i32 r, i32 g, i32 b) {
+   EGAColor best = 0;
+   i32 bestDist = INT32_MAX;
+   for (EGAColor c = 0; c < EGA_COLORS; ++c) {
+      auto rgb = egaGetColor(c);
+      i32 dr = rgb.r - r, dg = rgb.g - g, db = rgb.b - b;
+      i32 dist = dr * dr + dg * dg + db * db;
+      if (dist < bestDist) {
+         bestDist = dist;
+         best = c;
+      }
+   }
+   return best;
+}
+
+EGAPaletteAnimator *egaPaletteAnimatorCreate(EGAPalette const *base) {
+   auto self = new EGAPaletteAnimator();
+   self->base = *base;
+   return self;
+}
+void egaPaletteAnimatorDestroy(EGAPaletteAnimator *self) {
+   delete self;
+}
+
+void egaPaletteAnimatorSetBase(EGAPaletteAnimator *self, EGAPalette const *base) {
+   self->base = *base;
+   for (auto &fade : self->fades) {
+      fade.active = false;
+   }
+}
+void egaPaletteAnimatorClear(EGAPaletteAnimator *self) {
+   self->cycles.clear();
+   for (auto &fade : self->fades) {
+      fade.active = false;
+   }
+}
+
+void egaPaletteAnimatorAddCycle(EGAPaletteAnimator *self, EGAPColor first, EGAPColor last, f32 rate) {
+   if (first > last || last >= EGA_PALETTE_COLORS) {
+      return;
+   }
+
+   EGAPaletteCycle cycle;
+   cycle.first = first;
+   cycle.last = last;
+   cycle.rate = rate;
+   self->cycles.push_back(cycle);
+}
+
+void egaPaletteAnimatorFade(EGAPaletteAnimator *self, EGAPColor slot, EGAColor target, f32 seconds) {
+   if (slot >= EGA_PALETTE_COLORS || target >= EGA_COLORS) {
+      return;
+   }
+
+   if (seconds <= 0.0f) {
+      self->base.colors[slot] = target;
+      self->fades[slot].active = false;
       return;
    }
 
-   if (dx > dy) {
-      if (pos1.x > pos2.x) {//flip
-         x0 = pos2.x; y0 = pos2.y;
-         x1 = pos1.x; y1 = pos1.y;
+   auto &fade = self->fades[slot];
+   fade.active = true;
+   fade.from = self->base.colors[slot];
+   fade.to = target;
+   fade.duration = seconds;
+   fade.time = 0.0f;
+}
+
+bool egaPaletteAnimatorUpdate(EGAPaletteAnimator *self, f32 dt, EGAPalette *out) {
+   bool animating = !self->cycles.empty();
+   EGAPalette faded = self->base;
+
+   for (u32 i = 0; i < EGA_PALETTE_COLORS; ++i) {
+      auto &fade = self->fades[i];
+      if (!fade.active) {
+         continue;
       }
-      else {
-         x0 = pos1.x; y0 = pos1.y;
-         x1 = pos2.x; y1 = pos2.y;
+
+      animating = true;
+      fade.time += dt;
+      if (fade.time >= fade.duration || fade.from >= EGA_COLORS) {
+         fade.active = false;
+         self->base.colors[i] = faded.colors[i] = fade.to;
+         continue;
       }
 
-      x = x0;
-      y = y0;
-      slope = (float)(y1 - y0) / (float)(x1 - x0);
+      f32 t = fade.time / fade.duration;
+      auto a = egaGetColor(fade.from), b = egaGetColor(fade.to);
+      faded.colors[i] = _nearestEGAColor(
+         (i32)(a.r + (b.r - a.r) * t),
+         (i32)(a.g + (b.g - a.g) * t),
+         (i32)(a.b + (b.b - a.b) * t));
+   }
+
+   if (!animating) {
+      return false;
+   }
 
-      while (x < x1) {
-         egaRenderPoint(target, {(i32) x, (i32) y }, color, vp);
+   EGAPalette result = faded;
+   for (auto &cycle : self->cycles) {
+      i32 len = cycle.last - cycle.first + 1;
+      cycle.time += dt;
 
-         x += 1.0f;
-         y += slope;
+      i32 shift = (i32)((i64)floor(cycle.time * cycle.rate) % len);
+      if (shift < 0) {
+         shift += len;
       }
 
-      egaRenderPoint(target, { (i32)x1, (i32)y1 }, color, vp);
+      for (i32 i = 0; i < len; ++i) {
+         result.colors[cycle.first + (i + shift) % len] = faded.colors[cycle.first + i];
+      }
    }
-   else {
-      if (pos1.y > pos2.y) {//flip
-         x0 = pos2.x; y0 = pos2.y;
-         x1 = pos1.x; y1 = pos1.y;
+
+   *out = result;
+   return true;
+}
+
+#pragma endregion
+
+#pragma region COMMAND LISTS
+
+/*
+Commands get recorded with their args copied and run later against a target split into bands of rows
+every band runs every command that overlaps it, in order, clipped to its rows, so each pixel sees
+the same writes in the same order as the immediate calls would have made
+Bands only write pixels, the dirty rects get merged back on the calling thread afterward in command order
+*/
+
+// shortest band worth splitting off, thinner ones spend more time culling commands than drawing
+#define EGA_CMD_MIN_BAND 16
+
+enum EGACmd_ {
+   EGACmd_Clear = 0,
+   EGACmd_Texture,
+   EGACmd_Rect,
+   EGACmd_LineRect,
+   EGACmd_Lines,
+   EGACmd_Polyline,
+   EGACmd_Text
+};
+typedef byte EGACmdType;
+
+struct EGACommand {
+   EGACmdType type;
+   bool hasRegion;
+   bool skipSpaces;
+   EGAPColor color;
+   EGARegion region;
+   i64 top, bottom;        // rows it can touch, region-relative, bottom exclusive
+   Recti rect;             // rect, or uv for blits
+   Int2 pos;
+   EGATexture *tex;
+   EGAFont *font;
+   u32 first, count;       // into points or text
+};
+
+struct EGACommandList {
+   std::vector<EGACommand> commands;
+   std::vector<Int2> points;
+   std::vector<char> text;
+
+   // per execute
+   EGATexture *target = nullptr;
+   std::vector<EGARegion> regions;   // resolved per command
+   std::vector<Recti> touched;       // bandCount per command
+   i32 bandHeight = 0;
+   u32 bandCount = 0;
+   std::atomic<u32> nextBand;
+
+   // workers sleep between executes and wake on a new generation
+   std::vector<std::thread> workers;
+   std::mutex lock;
+   std::condition_variable wake, finished;
+   u64 generation = 0;
+   u32 workerLimit = 0;
+   u32 working = 0;
+   bool quit = false;
+};
+
+static EGACommand &_commandPush(EGACommandList *self, EGACmdType type, EGARegion *vp) {
+   self->commands.push_back({});
+   auto &cmd = self->commands.back();
+   cmd.type = type;
+   cmd.hasRegion = vp != nullptr;
+   if (vp) {
+      cmd.region = *vp;
+   }
+   return cmd;
+}
+
+static void _commandPushPoints(EGACommandList *self, EGACommand &cmd, Int2 const *points, u32 count) {
+   cmd.first = (u32)self->points.size();
+   cmd.count = count;
+   self->points.insert(self->points.end(), points, points + count);
+
+   cmd.top = INT64_MAX;
+   cmd.bottom = INT64_MIN;
+   for (u32 i = 0; i < count; ++i) {
+      cmd.top = MIN(cmd.top, (i64)points[i].y);
+      cmd.bottom = MAX(cmd.bottom, (i64)points[i].y + 1);
+   }
+}
+
+static void _commandRun(EGACommandList *self, u32 index, i32 bandTop, i32 bandBottom, Recti &touched) {
+   auto &cmd = self->commands[index];
+   auto &vp = self->regions[index];
+   auto target = self->target;
+
+   if (cmd.type == EGACmd_Texture) {
+      _blitTexture(target, cmd.pos, cmd.tex, cmd.rect, vp, touched, bandTop, bandBottom);
+      return;
+   }
+
+   EGARaster r;
+   if (!_rasterBegin(r, target, &vp, bandTop, bandBottom)) {
+      return;
+   }
+
+   Int2 const *points = self->points.data() + cmd.first;
+   switch (cmd.type) {
+   case EGACmd_Clear:
+   case EGACmd_Rect:
+      _rasterFill(r, cmd.rect.x, cmd.rect.y, cmd.rect.x + cmd.rect.w - 1, cmd.rect.y + cmd.rect.h - 1, cmd.color);
+      break;
+   case EGACmd_LineRect:
+      _rasterLineRect(r, cmd.rect, cmd.color);
+      break;
+   case EGACmd_Lines:
+      for (u32 i = 0; i < cmd.count; i += 2) {
+         _rasterLine(r, points[i], points[i + 1], cmd.color);
       }
-      else {
-         x0 = pos1.x; y0 = pos1.y;
-         x1 = pos2.x; y1 = pos2.y;
+      break;
+   case EGACmd_Polyline:
+      if (cmd.count == 1) {
+         _rasterPoint(r, points[0].x, points[0].y, cmd.color);
       }
+      for (u32 i = 1; i < cmd.count; ++i) {
+         _rasterLine(r, points[i - 1], points[i], cmd.color);
+      }
+      break;
+   case EGACmd_Text:
+      _rasterText(r, self->text.data() + cmd.first, cmd.pos, cmd.font, cmd.skipSpaces);
+      break;
+   }
 
-      x = x0;
-      y = y0;
-      slope = (float)(x1 - x0) / (float)(y1 - y);
+   _rasterTouched(r, touched);
+}
 
-      while (y < y1) {
+static void _commandListRunBands(EGACommandList *self) {
+   u32 band;
+   while ((band = self->nextBand++) < self->bandCount) {
+      i32 bandTop = (i32)band * self->bandHeight;
+      i32 bandBottom = MIN(bandTop + self->bandHeight, (i32)self->target->h);
 
-         egaRenderPoint(target, { (i32)x, (i32)y }, color, vp);
+      for (u32 i = 0; i < self->commands.size(); ++i) {
+         auto &cmd = self->commands[i];
+         auto &touched = self->touched[(u64)i * self->bandCount + band];
+         touched = { 0, 0, 0, 0 };
 
-         y += 1.0f;
-         x += slope;
+         i64 y = self->regions[i].y;
+         if (cmd.top + y < bandBottom && cmd.bottom + y > bandTop) {
+            _commandRun(self, i, bandTop, bandBottom, touched);
+         }
       }
-
-      egaRenderPoint(target, { (i32)x1, (i32)y1 }, color, vp);
    }
 }
-void egaRenderLineRect(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp) {
-   egaRenderLine(target, { r.x, r.y }, { r.x + r.w - 1, r.y }, color, vp);
-   egaRenderLine(target, { r.x + r.w - 1, r.y }, { r.x + r.w - 1, r.y + r.h - 1 }, color, vp);
-   egaRenderLine(target, { r.x, r.y + r.h - 1 }, { r.x + r.w - 1, r.y + r.h - 1 }, color, vp);
-   egaRenderLine(target, { r.x, r.y }, { r.x, r.y + r.h - 1 }, color, vp);
+
+static void _commandListWorker(EGACommandList *self, u32 index) {
+   u64 seen = 0;
+   std::unique_lock<std::mutex> lk(self->lock);
+
+   while (true) {
+      self->wake.wait(lk, [&] { return self->quit || self->generation != seen; });
+      if (self->quit) {
+         return;
+      }
+
+      seen = self->generation;
+      if (index < self->workerLimit) {
+         lk.unlock();
+         _commandListRunBands(self);
+         lk.lock();
+
+         if (--self->working == 0) {
+            self->finished.notify_one();
+         }
+      }
+   }
 }
-void egaRenderRect(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp) {
-   if (!vp) { vp = &target->fullRegion; }
 
-   if (r.x >= vp->w || r.y >= vp->h ||
-      r.x < -r.w || r.y < -r.h) {
+EGACommandList *egaCommandListCreate() {
+   return new EGACommandList();
+}
+void egaCommandListDestroy(EGACommandList *self) {
+   {
+      std::lock_guard<std::mutex> lk(self->lock);
+      self->quit = true;
+   }
+   self->wake.notify_all();
+   for (auto &worker : self->workers) {
+      worker.join();
+   }
+   delete self;
+}
+void egaCommandListReset(EGACommandList *self) {
+   self->commands.clear();
+   self->points.clear();
+   self->text.clear();
+}
+void egaCommandListExecute(EGACommandList *self, EGATexture *target, u32 threadCount) {
+   u32 cmdCount = (u32)self->commands.size();
+   if (!cmdCount || !target->h) {
       return;
    }
 
-   Recti drawRect = { 0 };
-   drawRect.x = r.x < 0 ? vp->x : r.x + vp->x;
-   drawRect.y = r.y < 0 ? vp->y : r.y + vp->y;
-   drawRect.w = r.x < 0 ? MIN(vp->w, r.w + r.x) : MIN(r.w, vp->w - r.x);
-   drawRect.h = r.y < 0 ? MIN(vp->h, r.h + r.y) : MIN(r.h, vp->h - r.y);
+   if (!threadCount) {
+      threadCount = MAX(1u, std::thread::hardware_concurrency());
+   }
+
+   self->target = target;
+   self->regions.resize(cmdCount);
+   for (u32 i = 0; i < cmdCount; ++i) {
+      auto &cmd = self->commands[i];
+      self->regions[i] = cmd.hasRegion ? cmd.region : target->fullRegion;
+
+      // spans get compiled lazily on blit, do it here before the bands share the source
+      if (cmd.type == EGACmd_Texture && cmd.tex->compiled && (cmd.tex->dirty & Tex_SPANS_DIRTY)) {
+         _compileSpans(cmd.tex);
+      }
+   }
+
+   // a few bands per thread so uneven bands even out, but not so thin every command lands in all of them
+   u32 bandCount = MIN(threadCount * 4, (target->h + EGA_CMD_MIN_BAND - 1) / EGA_CMD_MIN_BAND);
+   self->bandHeight = (i32)((target->h + bandCount - 1) / bandCount);
+   if (target->tiled) {
+      // bands can't share a row of tiles or two threads could allocate the same one
+      self->bandHeight = (self->bandHeight + EGA_TILE_MASK) & ~EGA_TILE_MASK;
+   }
+   self->bandCount = (target->h + self->bandHeight - 1) / self->bandHeight;
+   self->touched.resize((u64)cmdCount * self->bandCount);
+   self->nextBand = 0;
+
+   u32 helpers = MIN(threadCount, self->bandCount) - 1;
+   if (helpers) {
+      std::unique_lock<std::mutex> lk(self->lock);
+      while (self->workers.size() < helpers) {
+         self->workers.emplace_back(_commandListWorker, self, (u32)self->workers.size());
+      }
+
+      self->workerLimit = helpers;
+      self->working = helpers;
+      ++self->generation;
+      lk.unlock();
+      self->wake.notify_all();
+
+      _commandListRunBands(self);
+
+      lk.lock();
+      self->finished.wait(lk, [&] { return self->working == 0; });
+   }
+   else {
+      _commandListRunBands(self);
+   }
+
+   // dirty rects go in command order so they come out the same as immediate mode
+   for (u32 i = 0; i < cmdCount; ++i) {
+      auto &cmd = self->commands[i];
+      if (cmd.type == EGACmd_Clear && !cmd.hasRegion) {
+         _textureMarkAllDirty(target);
+         continue;
+      }
+
+      Recti merged = { 0, 0, 0, 0 };
+      bool any = false;
+      for (u32 band = 0; band < self->bandCount; ++band) {
+         auto &touched = self->touched[(u64)i * self->bandCount + band];
+         if (touched.w > 0 && touched.h > 0) {
+            merged = any ? _rectUnion(merged, touched) : touched;
+            any = true;
+         }
+      }
 
-   byte *destPixels = target->pixelData + (drawRect.y * target->w + drawRect.x);
-   for (int y = 0; y < drawRect.h; ++y) {
-      memset(destPixels, color, drawRect.w);
-      destPixels += target->w;
+      if (any) {
+         _textureMarkDirty(target, merged);
+      }
    }
-   target->dirty = Tex_ALL_DIRTY;
+
+   self->target = nullptr;
 }
 
-void egaRenderCircle(EGATexture *target, Int2 pos, int radius, EGAPColor color, EGARegion *vp) {
-   if (!vp) { vp = &target->fullRegion; }
+void egaCmdClear(EGACommandList *self, EGAPColor color, EGARegion *vp) {
+   auto &cmd = _commandPush(self, EGACmd_Clear, vp);
+   cmd.color = color;
+   cmd.top = 0;
+   cmd.bottom = vp ? vp->h : INT32_MAX;
+   cmd.rect = vp ? Recti{ 0, 0, vp->w, vp->h } : Recti{ 0, 0, INT32_MAX, INT32_MAX };
 }
-void egaRenderEllipse(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp) {
-   if (!vp) { vp = &target->fullRegion; }
+void egaCmdRenderTexture(EGACommandList *self, Int2 pos, EGATexture *tex, EGARegion *vp) {
+   egaCmdRenderTexturePartial(self, pos, tex, { 0, 0, (i32)tex->w, (i32)tex->h }, vp);
 }
-void egaRenderEllipseQB(EGATexture *target, Int2 pos, int radius, double aspect, EGAPColor color, EGARegion *vp) {
-   if (!vp) { vp = &target->fullRegion; }
+void egaCmdRenderTexturePartial(EGACommandList *self, Int2 pos, EGATexture *tex, Recti uv, EGARegion *vp) {
+   auto &cmd = _commandPush(self, EGACmd_Texture, vp);
+   cmd.pos = pos;
+   cmd.tex = tex;
+   cmd.rect = uv;
+   // uv clamping only ever moves pos down by what it takes off the height
+   cmd.top = pos.y;
+   cmd.bottom = (i64)pos.y + uv.h;
+}
+void egaCmdRenderLine(EGACommandList *self, Int2 pos1, Int2 pos2, EGAPColor color, EGARegion *vp) {
+   Int2 segment[2] = { pos1, pos2 };
+   egaCmdRenderLines(self, segment, 1, color, vp);
 }
+void egaCmdRenderLines(EGACommandList *self, Int2 const *segments, u32 segmentCount, EGAPColor color, EGARegion *vp) {
+   if (!segmentCount) {
+      return;
+   }
 
-void egaRenderTextSingleChar(EGATexture *target, const char c, Int2 pos, EGAFont *font, int spaces) {
+   auto &cmd = _commandPush(self, EGACmd_Lines, vp);
+   cmd.color = color;
+   _commandPushPoints(self, cmd, segments, segmentCount * 2);
+}
+void egaCmdRenderPolyline(EGACommandList *self, Int2 const *points, u32 count, EGAPColor color, EGARegion *vp) {
+   if (!count) {
+      return;
+   }
 
+   auto &cmd = _commandPush(self, EGACmd_Polyline, vp);
+   cmd.color = color;
+   _commandPushPoints(self, cmd, points, count);
 }
-void egaRenderText(EGATexture *target, const char *text, Int2 pos, EGAFont *font) {
+void egaCmdRenderLineRect(EGACommandList *self, Recti r, EGAPColor color, EGARegion *vp) {
+   auto &cmd = _commandPush(self, EGACmd_LineRect, vp);
+   cmd.color = color;
+   cmd.rect = r;
+   cmd.top = r.y;
+   cmd.bottom = (i64)r.y + r.h;
+}
+void egaCmdRenderRect(EGACommandList *self, Recti r, EGAPColor color, EGARegion *vp) {
+   auto &cmd = _commandPush(self, EGACmd_Rect, vp);
+   cmd.color = color;
+   cmd.rect = r;
+   cmd.top = r.y;
+   cmd.bottom = (i64)r.y + r.h;
+}
+
+static void _commandPushText(EGACommandList *self, const char *text, Int2 pos, EGAFont *font, bool skipSpaces) {
+   if (!font || !text) {
+      return;
+   }
+
+   auto &cmd = _commandPush(self, EGACmd_Text, nullptr);
+   cmd.pos = pos;
+   cmd.font = font;
+   cmd.skipSpaces = skipSpaces;
+   cmd.first = (u32)self->text.size();
+
+   u32 lines = 1;
+   for (auto c = text; *c; ++c) {
+      lines += *c == '\n';
+   }
+   self->text.insert(self->text.end(), text, text + strlen(text) + 1);
 
+   cmd.top = pos.y;
+   cmd.bottom = (i64)pos.y + (i64)lines * EGA_FONT_GLYPH_HEIGHT;
+}
+void egaCmdRenderText(EGACommandList *self, const char *text, Int2 pos, EGAFont *font) {
+   _commandPushText(self, text, pos, font, false);
+}
+void egaCmdRenderTextWithoutSpaces(EGACommandList *self, const char *text, Int2 pos, EGAFont *font) {
+   _commandPushText(self, text, pos, font, true);
 }
-void egaRenderTextWithoutSpaces(EGATexture *target, const char *text, Int2 pos, EGAFont *font) {
 
-}
\ No newline at end of file
+#pragma endregion
\ No newline at end of file
@@ -11,6 +11,7 @@
 #define EGA_TEXT_CHAR_HEIGHT 8
 #define EGA_PIXEL_HEIGHT 1.2f
 #define EGA_PIXEL_WIDTH 1.00f
+#define EGA_QB_ASPECT (5.0 / 6.0) // 4/3 * 200/320, what QB uses for CIRCLE in 320x200
 
 #define EGA_COLORS 64
 #define EGA_COLOR_UNDEFINED (EGA_COLORS) // used for palette generation, marks a color entry as able to be anything
@@ -39,27 +40,129 @@ void egaStartup();
 extern ColorRGB g_egaToRGBTable[64];
 #define egaGetColor(c) g_egaToRGBTable[c]
 
+// Palette animation, classic color cycling and fades
+// the animator keeps its own base palette and writes the animated result out every update
+// decoding only redoes the pixels using slots that changed, so cycling is cheap
+typedef struct EGAPaletteAnimator EGAPaletteAnimator;
+
+EGAPaletteAnimator *egaPaletteAnimatorCreate(EGAPalette const *base);
+void egaPaletteAnimatorDestroy(EGAPaletteAnimator *self);
+
+void egaPaletteAnimatorSetBase(EGAPaletteAnimator *self, EGAPalette const *base); // cancels fades
+void egaPaletteAnimatorClear(EGAPaletteAnimator *self); // stops all cycles and fades
+
+// rotates slots first-last (inclusive) by one slot rate times a second, negative rates go the other way
+void egaPaletteAnimatorAddCycle(EGAPaletteAnimator *self, EGAPColor first, EGAPColor last, f32 rate);
+
+// walks slot from its current color to target over seconds, stepping through the nearest EGA colors
+// the slot keeps target once its done
+void egaPaletteAnimatorFade(EGAPaletteAnimator *self, EGAPColor slot, EGAColor target, f32 seconds);
+
+// advances dt seconds and writes the animated palette to out
+// returns false and leaves out alone if nothing is animating
+bool egaPaletteAnimatorUpdate(EGAPaletteAnimator *self, f32 dt, EGAPalette *out);
+
 // EGATextures are encoded images consistenting of 4 bits per pixel, referring to a palette index
 // These were stored in 4 seperate bit planes but are intervleaved on the backend here
 // The texture handles all transparency, byte offsets, and rendering
 typedef struct EGATexture EGATexture;
 
 EGATexture *egaTextureCreate(u32 width, u32 height);
+// Tiled textures store pixels in 64x64 tiles that only get allocated once something opaque is drawn into them
+// so huge mostly-empty canvases cost memory by what's painted, they start fully transparent
+// Everything else works the same (decoding still needs a full size target) but compiling does nothing
+EGATexture *egaTextureCreateTiled(u32 width, u32 height);
 EGATexture *egaTextureCreateCopy(EGATexture const *other);
 void egaTextureDestroy(EGATexture *self);
 
+// Compiling caches each row's opaque runs so blitting this texture memcpys those and skips transparency entirely
+// Worth it for sprites and snippets that get drawn a lot more than they change
+// Drawing into the texture drops the cache, the next blit rebuilds it
+void egaTextureCompile(EGATexture *self);
+
 // encoding and decoding from an rgb texture
 typedef struct Texture Texture;
 EGATexture *egaTextureCreateFromTextureEncode(Texture *source, EGAPalette *targetPalette, EGAPalette *resultPalette);
 
+// the encode in two halves, for solving one palette across a whole set of images
+// histogram adds how many opaque pixels of source land on each of the 64 EGA colors into counts
+// reduce is the encode's palette solve, false if targetPalette has no usable entries
+// encoding with the result as the target palette maps straight onto it
+void egaTextureEncodeHistogram(Texture *source, u32 counts[EGA_COLORS]);
+bool egaPaletteReduce(u32 const counts[EGA_COLORS], EGAPalette *targetPalette, EGAPalette *resultPalette);
+
+// big encodes split across threads, this caps how many for encodes started from the calling thread
+// 0 (the default) is one per core, 1 keeps them on the calling thread
+void egaSetEncodeThreads(u32 threads);
+
 // target must exist and must match ega's size, returns !0 on success
 int egaTextureDecode(EGATexture *self, Texture* target, EGAPalette *palette);
 
-// binary serialization
-int egaTextureSerialize(EGATexture *self, byte **outBuff, u64 *size);
-EGATexture *egaTextureDeserialize(byte *buff, u64 size);
+// Scaled decodes for screenshots/capture/software presentation, written in one pass from the indices
+enum {
+   EGAScaleMode_NEAREST,   // scale x scale blocks
+   EGAScaleMode_ASPECT,    // nearest plus every 5 rows become 6 (EGA_PIXEL_HEIGHT)
+   EGAScaleMode_SCALE2X    // Scale2x/EPX to 2x, then nearest by scale on top of that
+};
+typedef byte EGAScaleMode;
+
+// output size for a texture of size
+Int2 egaScaledSize(Int2 size, EGAScaleMode mode, u32 scale);
+
+// out must hold egaScaledSize pixels, target must match egaScaledSize, returns !0 on success
+int egaTextureDecodeScaledToBuffer(EGATexture const *self, ColorRGBA *out, EGAPalette const *palette, EGAScaleMode mode, u32 scale = 1);
+int egaTextureDecodeScaled(EGATexture const *self, Texture *target, EGAPalette const *palette, EGAScaleMode mode, u32 scale = 1);
+
+// Tile palettes, for backgrounds that need more than 16 colors
+// the image is cut into tiles and each tile decodes with one of a small set of palettes
+// the indices are still a normal EGATexture, the tile map just says which palette goes where
+#define EGA_MAX_TILE_PALETTES 16
+typedef struct EGATilePalettes EGATilePalettes;
+
+// { width, n } tiles are scanline bands, edge tiles are clipped to the image
+// all tiles start on palette 0 and every palette starts black
+EGATilePalettes *egaTilePalettesCreate(u32 width, u32 height, Int2 tileSize, u32 paletteCount);
+void egaTilePalettesDestroy(EGATilePalettes *self);
+
+Int2 egaTilePalettesGetTileSize(EGATilePalettes const *self);
+Int2 egaTilePalettesGetTileCount(EGATilePalettes const *self); // tiles across and down
+u32 egaTilePalettesGetPaletteCount(EGATilePalettes const *self);
+EGAPalette *egaTilePalettesGetPalette(EGATilePalettes *self, u32 index);
+byte egaTilePalettesGetTile(EGATilePalettes const *self, u32 tx, u32 ty);
+void egaTilePalettesSetTile(EGATilePalettes *self, u32 tx, u32 ty, byte palette);
+
+// clusters the tiles into up to paletteCount palettes, fewer if the image doesn't need them
+// *palettesOut gets the palettes and tile map, null for an empty source
+EGATexture *egaTextureCreateFromTextureEncodeTilePalettes(Texture *source, Int2 tileSize, u32 paletteCount, EGATilePalettes **palettesOut);
+
+// out must hold w*h pixels, target and palettes must match the texture's size, returns !0 on success
+int egaTextureDecodeTilePalettesToBuffer(EGATexture const *self, ColorRGBA *out, EGATilePalettes const *palettes);
+int egaTextureDecodeTilePalettes(EGATexture const *self, Texture *target, EGATilePalettes const *palettes);
+
+// binary serialization, the result is an SCF document
+enum {
+   EGATextureFormat_AUTO = 0, // whichever of the two comes out smaller
+   EGATextureFormat_PACKED,   // 4bpp plus an opacity mask, can be viewed in place with egaPackedTextureCreateView
+   EGATextureFormat_SPANS     // run-length rows with transparent spans skipped, best for sprites
+};
+typedef byte EGATextureFormat;
+
+// textures over EGA_SERIAL_MAX_PIXELS (16k x 16k) fail both ways, keeps garbage headers from allocating gigabytes
+#define EGA_SERIAL_MAX_PIXELS (1u << 28)
+
+// *outBuff is new[]'d, returns !0 on success
+int egaTextureSerialize(EGATexture *self, byte **outBuff, u64 *size, EGATextureFormat format = EGATextureFormat_AUTO);
+EGATexture *egaTextureDeserialize(byte const *buff, u64 size); // null if buff isn't a valid texture
 
 Int2 egaTextureGetSize(EGATexture const *self);
+u64 egaTextureGetMemorySize(EGATexture const *self); // pixels plus the decode buffer if its been decoded
+
+// Textures track which areas have been drawn to since the last decode so decode/upload only touch those
+// Past EGA_MAX_DIRTY_RECTS they get merged together, so this is a conservative cover and not exact
+// Returns the pending rects (texture coords) and the count, count is 0 if nothing changed
+// if the whole texture is dirty you get a single rect of the full texture
+#define EGA_MAX_DIRTY_RECTS 16
+Recti const *egaTextureGetDirtyRects(EGATexture *self, u32 *countOut);
 
 void egaTextureResize(EGATexture *self, u32 width, u32 height);
 
@@ -73,37 +176,151 @@ EGARegion *egaTextureGetFullRegion(EGATexture *self);
 
 EGAPColor egaTextureGetColorAt(EGATexture *self, u32 x, u32 y, EGARegion *vp = nullptr);
 
+// copies out all w*h palette indices row-major, EGA_ALPHA for transparent
+void egaTextureGetIndices(EGATexture const *self, byte *out);
+
+// Packed textures are the compact storage form of an EGATexture
+// 2 pixels per byte plus a 1-bit opacity mask, a little over half the size
+// you dont draw into these with the normal calls, pack a texture and blit/decode the result
+typedef struct EGAPackedTexture EGAPackedTexture;
+
+EGAPackedTexture *egaPackedTextureCreate(u32 width, u32 height); // starts fully transparent
+EGAPackedTexture *egaPackedTextureCreateFromTexture(EGATexture const *source);
+
+// no copy, reads straight out of a PACKED egaTextureSerialize buffer (like a MappedFile) which has to outlive it
+// null if buff isn't PACKED or isn't 8-byte aligned, views are read-only: SetColorAt, Clear and Render into one do nothing
+EGAPackedTexture *egaPackedTextureCreateView(byte const *buff, u64 size);
+void egaPackedTextureDestroy(EGAPackedTexture *self);
+
+Int2 egaPackedTextureGetSize(EGAPackedTexture const *self);
+u64 egaPackedTextureGetMemorySize(EGAPackedTexture const *self);
+
+// returns EGA_COLOR_UNDEFINED for transparent or out of bounds
+EGAPColor egaPackedTextureGetColorAt(EGAPackedTexture const *self, u32 x, u32 y);
+void egaPackedTextureSetColorAt(EGAPackedTexture *self, u32 x, u32 y, EGAPColor color); // EGA_ALPHA to clear
+
+// pass EGA_ALPHA to clear to transparent
+void egaPackedTextureClear(EGAPackedTexture *self, EGAPColor color);
+
+// transparent blits, only opaque source pixels are written
+void egaPackedTextureRender(EGAPackedTexture *target, Int2 pos, EGAPackedTexture const *tex);
+void egaRenderPackedTexture(EGATexture *target, Int2 pos, EGAPackedTexture const *tex, EGARegion *vp = nullptr);
+
+// target must exist and must match the packed texture's size, returns !0 on success
+int egaPackedTextureDecode(EGAPackedTexture const *self, Texture *target, EGAPalette *palette);
+
+
+// Undo history for a texture, each revision only stores the tiles that changed from the one before it
+// unchanged tiles are shared between revisions
+typedef struct EGAHistory EGAHistory;
+
+// 0 for no limit, past the budget the oldest revisions get dropped (the current one is always kept)
+EGAHistory *egaHistoryCreate(u64 memoryBudget = 0);
+void egaHistoryDestroy(EGAHistory *self);
+void egaHistoryClear(EGAHistory *self);
+
+// snapshots tex as the newest revision, drops any redo
+void egaHistoryCommit(EGAHistory *self, EGATexture const *tex);
+
+// only rewrites the tiles of target that differ, resizes target if the revision is a different size
+// false if theres nothing to undo/redo
+bool egaHistoryUndo(EGAHistory *self, EGATexture *target);
+bool egaHistoryRedo(EGAHistory *self, EGATexture *target);
+
+u32 egaHistoryGetCount(EGAHistory const *self);
+u32 egaHistoryGetPosition(EGAHistory const *self);
+u64 egaHistoryGetMemorySize(EGAHistory const *self);
+
 
 // The font factory manages fonts, theres only one "font" in EGA
 // Font in this case means color, background/foreground
 typedef struct EGAFontFactory EGAFontFactory;
 typedef struct EGAFont EGAFont;
 
+#define EGA_FONT_GLYPHS 256
+#define EGA_FONT_GLYPH_WIDTH 8
+#define EGA_FONT_GLYPH_HEIGHT 14
+
 /*
 Image must be:
 - 256x112 with 256 8x14 characters organized according to ascii
 - solid 1 alpha (no transparency)
 - 2-color palette; 0 or background and 1 for foreground
+returns null if the image is the wrong size
 */
 EGAFontFactory *egaFontFactoryCreate(EGATexture *font);
 void egaFontFactoryDestroy(EGAFontFactory *self);
-EGAFont *egaFontFactoryGetFont(EGAFontFactory *self, EGAColor bgColor, EGAColor fgColor);
+
+// Fonts are built on first use and owned by the factory
+// colors are palette indices written to the target as-is, bgColor can be EGA_ALPHA to leave the background alone
+// null for anything outside the palette
+EGAFont *egaFontFactoryGetFont(EGAFontFactory *self, EGAPColor bgColor, EGAPColor fgColor);
 
 
 void egaClear(EGATexture *target, EGAPColor color, EGARegion *vp = nullptr);
 void egaClearAlpha(EGATexture *target);
-void egaColorReplace(EGATexture *target, EGAPColor oldCOlor, EGAPColor newColor);
+
+// every palette index in the region gets replaced with lut[index], lut entries can be EGA_ALPHA
+// transparent pixels are left alone, one pass over the region
+void egaRemapIndices(EGATexture *target, EGAPColor const lut[EGA_PALETTE_COLORS], EGARegion *vp = nullptr);
+
+// egaRemapIndices for one color, oldColor can be transparent (anything outside the palette)
+void egaColorReplace(EGATexture *target, EGAPColor oldColor, EGAPColor newColor);
+
+// fills the area connected to pos that matches pos's color (transparent matches transparent)
+// 4-way by default, eightWay also connects diagonals, the fill stays inside vp
+// returns the bounds of what got filled in region coords, w/h are 0 if nothing was
+Recti egaFloodFill(EGATexture *target, Int2 pos, EGAPColor color, bool eightWay = false, EGARegion *vp = nullptr);
+
 void egaRenderTexture(EGATexture *target, Int2 pos, EGATexture *tex, EGARegion *vp = nullptr);
 void egaRenderTexturePartial(EGATexture *target, Int2 pos, EGATexture *tex, Recti uv, EGARegion *vp = nullptr);
 void egaRenderPoint(EGATexture *target, Int2 pos, EGAPColor color, EGARegion *vp = nullptr);
+void egaRenderPoints(EGATexture *target, Int2 const *points, u32 count, EGAPColor color, EGARegion *vp = nullptr);
 void egaRenderLine(EGATexture *target, Int2 pos1, Int2 pos2, EGAPColor color, EGARegion *vp = nullptr);
+// segments is pairs of endpoints, 2 * segmentCount points
+void egaRenderLines(EGATexture *target, Int2 const *segments, u32 segmentCount, EGAPColor color, EGARegion *vp = nullptr);
+// connects each point to the next
+void egaRenderPolyline(EGATexture *target, Int2 const *points, u32 count, EGAPColor color, EGARegion *vp = nullptr);
 void egaRenderLineRect(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp = nullptr);
 void egaRenderRect(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp = nullptr);
 
 void egaRenderCircle(EGATexture *target, Int2 pos, int radius, EGAPColor color, EGARegion *vp = nullptr);
+void egaRenderCircleFilled(EGATexture *target, Int2 pos, int radius, EGAPColor color, EGARegion *vp = nullptr);
+// ellipse inscribed in r
 void egaRenderEllipse(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp = nullptr);
+void egaRenderEllipseFilled(EGATexture *target, Recti r, EGAPColor color, EGARegion *vp = nullptr);
+// QuickBASIC CIRCLE semantics, aspect is y/x and radius is the longer axis, EGA_QB_ASPECT is the SCREEN 7 default
 void egaRenderEllipseQB(EGATexture *target, Int2 pos, int radius, double aspect, EGAPColor color, EGARegion *vp = nullptr);
+void egaRenderEllipseQBFilled(EGATexture *target, Int2 pos, int radius, double aspect, EGAPColor color, EGARegion *vp = nullptr);
 
+// pos is the top-left pixel of the first glyph, spaces shifts it right by that many characters
 void egaRenderTextSingleChar(EGATexture *target, const char c, Int2 pos, EGAFont *font, int spaces);
+// '\n' returns to pos.x one glyph lower
 void egaRenderText(EGATexture *target, const char *text, Int2 pos, EGAFont *font);
+// same as egaRenderText but spaces leave the target untouched
 void egaRenderTextWithoutSpaces(EGATexture *target, const char *text, Int2 pos, EGAFont *font);
+
+// Command lists record draw calls to run later against a target
+// Executing splits the target into bands of rows that get drawn in parallel, the result (pixels and dirty rects)
+// is the same as making the calls immediately in order
+// Textures and fonts are referenced so they must live until execute and a blit source can't be the target,
+// everything else is copied when recorded
+typedef struct EGACommandList EGACommandList;
+
+EGACommandList *egaCommandListCreate();
+void egaCommandListDestroy(EGACommandList *self);
+void egaCommandListReset(EGACommandList *self); // drops the recorded commands
+// threadCount 0 uses every core, lists are executed one at a time
+void egaCommandListExecute(EGACommandList *self, EGATexture *target, u32 threadCount = 0);
+
+// same as their immediate versions, vp is copied and nullptr means the target's full region at execute
+void egaCmdClear(EGACommandList *self, EGAPColor color, EGARegion *vp = nullptr);
+void egaCmdRenderTexture(EGACommandList *self, Int2 pos, EGATexture *tex, EGARegion *vp = nullptr);
+void egaCmdRenderTexturePartial(EGACommandList *self, Int2 pos, EGATexture *tex, Recti uv, EGARegion *vp = nullptr);
+void egaCmdRenderLine(EGACommandList *self, Int2 pos1, Int2 pos2, EGAPColor color, EGARegion *vp = nullptr);
+void egaCmdRenderLines(EGACommandList *self, Int2 const *segments, u32 segmentCount, EGAPColor color, EGARegion *vp = nullptr);
+void egaCmdRenderPolyline(EGACommandList *self, Int2 const *points, u32 count, EGAPColor color, EGARegion *vp = nullptr);
+void egaCmdRenderLineRect(EGACommandList *self, Recti r, EGAPColor color, EGARegion *vp = nullptr);
+void egaCmdRenderRect(EGACommandList *self, Recti r, EGAPColor color, EGARegion *vp = nullptr);
+void egaCmdRenderText(EGACommandList *self, const char *text, Int2 pos, EGAFont *font);
+void egaCmdRenderTextWithoutSpaces(EGACommandList *self, const char *text, Int2 pos, EGAFont *font);
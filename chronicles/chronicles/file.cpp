@@ -0,0 +1,137 @@
+#include "file.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <nowide/convert.hpp>
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct MappedFile {
+   byte const *data = nullptr;
+   u64 size = 0;
+
+#ifdef _WIN32
+   HANDLE file = INVALID_HANDLE_VALUE;
+   HANDLE mapping = nullptr;
+#endif
+};
+
+// empty files can't be mapped but they're still valid files
+static const byte g_emptyFile[1] = { 0 };
+
+#ifdef _WIN32
+
+MappedFile *fileMap(StringView path) {
+   auto file = CreateFileW(nowide::widen(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+   if (file == INVALID_HANDLE_VALUE) {
+      return nullptr;
+   }
+
+   LARGE_INTEGER size;
+   if (!GetFileSizeEx(file, &size)) {
+      CloseHandle(file);
+      return nullptr;
+   }
+
+   auto out = new MappedFile();
+   out->file = file;
+   out->size = (u64)size.QuadPart;
+
+   if (!out->size) {
+      out->data = g_emptyFile;
+      return out;
+   }
+
+   out->mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   if (out->mapping) {
+      out->data = (byte const*)MapViewOfFile(out->mapping, FILE_MAP_READ, 0, 0, 0);
+   }
+
+   if (!out->data) {
+      fileUnmap(out);
+      return nullptr;
+   }
+
+   return out;
+}
+
+void fileUnmap(MappedFile *self) {
+   if (self->data && self->data != g_emptyFile) {
+      UnmapViewOfFile(self->data);
+   }
+   if (self->mapping) {
+      CloseHandle(self->mapping);
+   }
+   CloseHandle(self->file);
+   delete self;
+}
+
+#else
+
+MappedFile *fileMap(StringView path) {
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      return nullptr;
+   }
+
+   struct stat st;
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      close(fd);
+      return nullptr;
+   }
+
+   auto out = new MappedFile();
+   out->size = (u64)st.st_size;
+
+   if (!out->size) {
+      out->data = g_emptyFile;
+   }
+   else {
+      auto mapped = mmap(nullptr, out->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+         out->data = (byte const*)mapped;
+      }
+   }
+
+   // the mapping holds its own reference to the file
+   close(fd);
+
+   if (!out->data) {
+      delete out;
+      return nullptr;
+   }
+
+   return out;
+}
+
+void fileUnmap(MappedFile *self) {
+   if (self->data != g_emptyFile) {
+      munmap((void*)self->data, self->size);
+   }
+   delete self;
+}
+
+#endif
+
+byte const *fileGetData(MappedFile const *self) {
+   return self->data;
+}
+u64 fileGetSize(MappedFile const *self) {
+   return self->size;
+}
+
+bool fileWrite(StringView path, void const *data, u64 size) {
+   auto f = fopen(path, "wb");
+   if (!f) {
+      return false;
+   }
+
+   bool ok = !size || fwrite(data, size, 1, f) == 1;
+   return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "defs.h"
+
+// Files
+// assets get memory mapped read-only, the data pointer is a view straight into the mapping
+// so nothing gets copied until you copy it, and it stays valid until fileUnmap
+
+typedef struct MappedFile MappedFile;
+
+MappedFile *fileMap(StringView path); // nullptr if it doesn't exist or can't be mapped
+void fileUnmap(MappedFile *self);
+
+byte const *fileGetData(MappedFile const *self); // not null terminated
+u64 fileGetSize(MappedFile const *self);
+
+// writes the whole buffer out, replacing whatever was there
+bool fileWrite(StringView path, void const *data, u64 size);
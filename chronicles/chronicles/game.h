@@ -2,6 +2,7 @@
 
 #include "math.h"
 #include "ega.h"
+#include "assets.h"
 
 #include <vector>
 #include <string>
@@ -9,8 +10,6 @@
 typedef struct Texture Texture;
 typedef struct EGATexture EGATexture;
 
-typedef struct Assets Assets;
-
 struct GameData {
    struct {
       ColorRGBAf bgClearColor = { 0.45f, 0.55f, 0.60f, 1.0f };  // clear color behond all imgui windows
@@ -21,6 +20,7 @@ struct GameData {
       Texture* texture = nullptr;                        // populated with egaTexture every frame
       EGATexture* egaTexture = nullptr;                  //drawn to every game update
       EGAPalette palette;
+      EGAPaletteAnimator* paletteAnimator = nullptr;    // cycles/fades, writes into palette every update while active
 
    } primaryView;
 
@@ -34,15 +34,10 @@ Game* gameCreate(StringView assetsFolder);
 GameData* gameData(Game* game);
 
 typedef struct Window Window;
-void gameUpdate(Game* game, Window* wnd);
+void gameUpdate(Game* game, Window* wnd);  // gameStep with the frame's delta and then the UI
+
+// everything but the UI, safe to run with no window or imgui (headless runs call this directly)
+void gameStep(Game* game, f32 dt);
 
 void gameDestroy(Game* game);
 void gameDoUI(Window* wnd);
-
-void        assetsPaletteStore(Assets *assets, StringView name, EGAPalette *pal);
-void        assetsPaletteDelete(Assets *assets, StringView name);
-EGAPalette *assetsPaletteRetrieve(Assets *assets, StringView name);
-std::vector<std::string> assetsPaletteGetList(Assets *assets, StringView search = nullptr);
-
-
-
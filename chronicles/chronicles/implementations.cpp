@@ -1,5 +1,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+
 #define STB_SPRINTF_IMPLEMENTATION
 #include <stb/stb_sprintf.h>
\ No newline at end of file
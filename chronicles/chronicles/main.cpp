@@ -9,6 +9,16 @@ static void _parseArgs(int argc, char** argv, AppConfig &config) {
       if (!strcmp(*arg, "-assets") && ++arg < end) {
          config.assetFolder = *arg;
       }
+      else if (!strcmp(*arg, "-headless") && ++arg < end) {
+         config.headless = true;
+         config.headlessFrames = (u32)atoi(*arg);
+      }
+      else if (!strcmp(*arg, "-capture") && ++arg < end) {
+         config.captureFolder = *arg;
+      }
+      else if (!strcmp(*arg, "-raw")) {
+         config.captureRaw = true;
+      }
    }
 }
 
@@ -19,6 +29,12 @@ int main(int argc, char** argv)
 
    auto app = appCreate(config);
 
+   if (config.headless) {
+      appRunHeadless(app);
+      appDestroy(app);
+      return 0;
+   }
+
    appCreateWindow(app, WindowConfig{ 1280, 720, "CRN4.EXE" });
 
    while (appRunning(app)) {      
@@ -1,5 +1,6 @@
 #include "scf.h"
 
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -24,6 +25,12 @@ static u32 _dataOffset(SCFType const* typeList) {
    //_roundUp(tlist.size + 1) - (tlist.size);
 }
 
+// always true for plain scfView readers, they don't know how big the buffer is
+static bool _inBounds(SCFReader const& view, void const* data, u64 size) {
+   auto p = (byte const*)data, end = (byte const*)view.end;
+   return !end || (p >= (byte const*)view.header && p <= end && size <= (u64)(end - p));
+}
+
 static u32 _currentTypeSize(SCFReader const& view) {
    switch (*view.typeList) {
    case SCFType_NULL: return 0;
@@ -54,6 +61,28 @@ SCFReader scfView(void const* scf) {
 
    return out;
 }
+SCFReader scfViewBuffer(void const* data, u64 size) {
+   if (!data || size < sizeof(SCFHeader)) {
+      return {};
+   }
+
+   auto header = (SCFHeader const*)data;
+   if (header->magic != SCF_MAGIC_NUMBER ||
+      header->binarySegmentOffset < sizeof(SCFHeader) ||
+      header->binarySegmentOffset > size) {
+      return {};
+   }
+
+   // the root type list has to end before the binary segment does or reading it runs off the end
+   auto typeList = (byte const*)data + sizeof(SCFHeader);
+   if (!memchr(typeList, SCFType_NULL, header->binarySegmentOffset - sizeof(SCFHeader))) {
+      return {};
+   }
+
+   auto out = scfView(data);
+   out.end = (byte const*)data + size;
+   return out;
+}
 bool scfReaderNull(SCFReader const& view) {
    return !view.header;
 }
@@ -73,13 +102,17 @@ void scfReaderSkip(SCFReader& view) {
 }
 
 SCFReader scfReadList(SCFReader& view) {
-   if (*view.typeList != SCFType_SUBLIST) { return {};  }
+   if (*view.typeList != SCFType_SUBLIST || !_inBounds(view, view.pos, sizeof(u32))) { return {};  }
 
    u32 listSize = *(u32*)view.pos;
 
    SCFReader out;
    out.header = view.header;
+   out.end = view.end;
    out.typeList = (byte*)view.pos + sizeof(u32);
+   if (!_inBounds(view, out.typeList, listSize) || (view.end && !memchr(out.typeList, SCFType_NULL, listSize))) {
+      return {};
+   }
    out.pos = (byte*)out.typeList + _dataOffset(out.typeList);
 
    (byte*&)view.pos += sizeof(u32) + listSize;
@@ -88,29 +121,38 @@ SCFReader scfReadList(SCFReader& view) {
    return out;
 }
 i32 const* scfReadInt(SCFReader& view) {
-   if (*view.typeList != SCFType_INT) { return nullptr; }
+   if (*view.typeList != SCFType_INT || !_inBounds(view, view.pos, sizeof(i32))) { return nullptr; }
    auto out = (i32*)view.pos;
    scfReaderSkip(view);
    return out;
 }
 f32 const* scfReadFloat(SCFReader& view) {
-   if (*view.typeList != SCFType_FLOAT) { return nullptr; }
+   if (*view.typeList != SCFType_FLOAT || !_inBounds(view, view.pos, sizeof(f32))) { return nullptr; }
    auto out = (f32*)view.pos;
    scfReaderSkip(view);
    return out;
 }
 StringView scfReadString(SCFReader& view) {
-   if (*view.typeList != SCFType_STRING) { return nullptr; }
+   if (*view.typeList != SCFType_STRING || !_inBounds(view, view.pos, sizeof(u32))) { return nullptr; }
    auto offset = *(u32*)view.pos;
    scfReaderSkip(view);
-   return (StringView)((byte*)view.header + view.header->binarySegmentOffset + offset);
+
+   auto str = (byte*)view.header + view.header->binarySegmentOffset + offset;
+   if (view.end && (!_inBounds(view, str, 0) || !memchr(str, 0, (byte const*)view.end - str))) {
+      return nullptr;
+   }
+   return (StringView)str;
 }
 byte const* scfReadBytes(SCFReader& view, u32* sizeOut) {
-   if (*view.typeList != SCFType_BYTES) { return nullptr; }
+   if (*view.typeList != SCFType_BYTES || !_inBounds(view, view.pos, sizeof(u32))) { return nullptr; }
    auto offset = *(u32*)view.pos;
    scfReaderSkip(view);
 
    auto bin = (byte*)view.header + view.header->binarySegmentOffset + offset;
+   if (!_inBounds(view, bin, sizeof(u32)) || !_inBounds(view, bin + sizeof(u32), *(u32*)bin)) {
+      return nullptr;
+   }
+
    *sizeOut = *(u32*)bin;
    return bin + sizeof(u32);
 }
@@ -123,7 +165,7 @@ struct SCFBuffer {
       if (capacity < size + count) {
          capacity = (size+count) * 2;
          byte* newBuff = new byte[capacity];
-         memcpy(newBuff, data, size);
+         if (size) { memcpy(newBuff, data, size); }
          delete[] data;
          data = newBuff;
       }
@@ -133,21 +175,101 @@ struct SCFBuffer {
       grow(1);
       data[size++] = b;
    }
-   void push(byte*buff, u32 len) {
+   void push(byte const*buff, u32 len) {
+      if (!len) { return; }
       grow(len);
       memcpy(data + size, buff, len);
       size += len;
    }
+   void pushZeros(u32 len) {
+      grow(len);
+      memset(data + size, 0, len);
+      size += len;
+   }
+};
+
+// every list lives in the arena the way it will in the file: its size, its type list and then its data
+// the type list space is reserved when the list opens (types are written straight into it) and the size
+// gets patched when it closes, so nothing is ever copied up into the parent
+// the reservation is a guess, if it runs out or is too big the list's data gets shifted over once
+struct SCFOpenList {
+   u32 sizePos = 0;     // offset of the u32 list size, unused for the root
+   u32 typesPos = 0;    // offset of the type list
+   u32 reserved = 0;    // bytes set aside for the type list, its null and padding
+   u32 count = 0;       // types written so far
 };
 
 struct SCFWriter {
-   std::vector<SCFBuffer> currentTypeList;
-   std::vector<SCFBuffer> currentDataSet;
+   SCFBuffer arena;           // header, root type list and every list's data, in file order
+   SCFBuffer binarySegment;   // strings and bytes, goes on the end of the arena at scfWriteToBuffer
+   std::vector<SCFOpenList> lists;
 
-   SCFBuffer dataSegment;
-   SCFBuffer binarySegment;
+   // type list size of the last list closed at each depth, documents tend to be lots of the same record
+   // so this is usually exactly right and the data never has to move
+   std::vector<u32> reserveHints;
 };
 
+static u32 _dataStart(SCFOpenList const& list) {
+   return list.typesPos + list.reserved;
+}
+
+// move everything after the type list so there's exactly reserved bytes for it, new space is zeroed
+static void _resizeTypeList(SCFWriter* writer, SCFOpenList& list, u32 reserved) {
+   auto &arena = writer->arena;
+   u32 dataStart = _dataStart(list);
+   u32 dataSize = arena.size - dataStart;
+
+   if (reserved > list.reserved) {
+      arena.grow(reserved - list.reserved);
+   }
+
+   memmove(arena.data + list.typesPos + reserved, arena.data + dataStart, dataSize);
+   if (reserved > list.reserved) {
+      memset(arena.data + dataStart, 0, reserved - list.reserved);
+   }
+
+   arena.size = list.typesPos + reserved + dataSize;
+   list.reserved = reserved;
+}
+
+static void _pushType(SCFWriter* writer, SCFType type) {
+   auto &list = writer->lists.back();
+   if (list.count + 1 >= list.reserved) {
+      _resizeTypeList(writer, list, _roundUp(list.reserved * 2 + 1));
+   }
+   writer->arena.data[list.typesPos + list.count++] = type;
+}
+
+static void _openList(SCFWriter* writer) {
+   u32 depth = (u32)writer->lists.size();
+   if (writer->reserveHints.size() <= depth) {
+      writer->reserveHints.push_back(4);
+   }
+
+   SCFOpenList list;
+   list.typesPos = writer->arena.size;
+   list.reserved = writer->reserveHints[depth];
+   writer->arena.pushZeros(list.reserved);
+   writer->lists.push_back(list);
+}
+
+// trims the type list down to exactly what the reader expects and returns the list's full size
+static u32 _closeList(SCFWriter* writer) {
+   auto &list = writer->lists.back();
+   u32 reserved = _roundUp(list.count + 1);
+   if (reserved != list.reserved) {
+      _resizeTypeList(writer, list, reserved);
+   }
+
+   writer->reserveHints[writer->lists.size() - 1] = reserved;
+
+   u32 listSize = writer->arena.size - list.typesPos;
+   writer->lists.pop_back();
+   return listSize;
+}
+
+// headless builds (tools, the bench) have no imgui to draw into
+#ifndef CHRONICLES_HEADLESS
 static StringView _typeName(SCFType type) {
    switch (type) {
    case SCFType_NULL: return "Null";
@@ -161,134 +283,112 @@ static StringView _typeName(SCFType type) {
 }
 #include <imgui.h>
 void DEBUG_imShowWriterStats(SCFWriter *writer) {
-   ImGui::Text("List stack size: %d", writer->currentTypeList.size());
+   ImGui::Text("List stack size: %d", writer->lists.size());
 
+   auto &list = writer->lists.back();
    if (ImGui::TreeNode("Current Type List")) {
-      auto &l = writer->currentTypeList.back();
-      for (u32 i = 0; i < l.size; ++i) {
-         ImGui::Text(_typeName(l.data[i]));
+      for (u32 i = 0; i < list.count; ++i) {
+         ImGui::Text(_typeName(writer->arena.data[list.typesPos + i]));
       }
       ImGui::TreePop();
    }
 
-   ImGui::Text("Current List Dataset Size: %d", writer->currentDataSet.back().size);
+   ImGui::Text("Current List Dataset Size: %d", writer->arena.size - _dataStart(list));
+   ImGui::Text("Arena Size: %d", writer->arena.size);
    ImGui::Text("Current Binary Segment Size: %d", writer->binarySegment.size);
 }
+#endif
 
 SCFWriter* scfWriterCreate() {
    auto out = new SCFWriter();
-   out->currentTypeList.push_back({});
-   out->currentDataSet.push_back({});
+
+   SCFHeader header;
+   out->arena.push((byte*)&header, sizeof(header));
+   _openList(out); // the root, its type list comes right after the header
    return out;
 }
 void scfWriterDestroy(SCFWriter* writer) {
-
-   for (auto &l : writer->currentTypeList) {
-      if (l.data) { delete[] l.data; }
-   }
-
-   for (auto &l : writer->currentDataSet) {
-      if (l.data) { delete[] l.data; }
-   }
-
+   delete[] writer->arena.data;
+   delete[] writer->binarySegment.data;
    delete writer;
 }
 
 void scfWriteListBegin(SCFWriter* writer) {
-   writer->currentTypeList.back().push(SCFType_SUBLIST);
-   writer->currentTypeList.push_back({});
-   writer->currentDataSet.push_back({});
+   _pushType(writer, SCFType_SUBLIST);
+
+   u32 sizePos = writer->arena.size;
+   writer->arena.pushZeros(sizeof(u32));
+   _openList(writer);
+   writer->lists.back().sizePos = sizePos;
 }
 void scfWriteListEnd(SCFWriter* writer) {
-   if (writer->currentTypeList.size() <= 1) {
+   if (writer->lists.size() <= 1) {
       return;
    }
 
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
-
-   int padding = _roundUp(tlist.size + 1) - (tlist.size);
-   u32 listSize = tlist.size + padding + dSet.size;
-
-   //we push our data onto the parents dataset
-   auto &parentSet = *(writer->currentDataSet.end() - 2);
-   parentSet.grow(sizeof(listSize) + listSize); // small optimization for a large growth
-   parentSet.push((byte*)&listSize, sizeof(listSize)); //push list size
-   parentSet.push((byte*)tlist.data, tlist.size); //push typelist
-   parentSet.push((byte*)"\0\0\0\0", padding); //push padding
-   parentSet.push((byte*)dSet.data, dSet.size); //push dataset
-
-   if (tlist.data) { delete[] tlist.data; }
-   if (dSet.data) { delete[] dSet.data; }
-
-   writer->currentTypeList.erase(writer->currentTypeList.end() - 1);
-   writer->currentDataSet.erase(writer->currentDataSet.end() - 1);
+   u32 sizePos = writer->lists.back().sizePos;
+   u32 listSize = _closeList(writer);
+   memcpy(writer->arena.data + sizePos, &listSize, sizeof(listSize));
 }
 void scfWriteInt(SCFWriter* writer, i32 i) {
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
-
-   tlist.push(SCFType_INT);
-   dSet.push((byte*)&i, sizeof(i));
+   _pushType(writer, SCFType_INT);
+   writer->arena.push((byte*)&i, sizeof(i));
 }
 void scfWriteFloat(SCFWriter* writer, f32 f) {
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
-
-   tlist.push(SCFType_FLOAT);
-   dSet.push((byte*)&f, sizeof(f));
+   _pushType(writer, SCFType_FLOAT);
+   writer->arena.push((byte*)&f, sizeof(f));
 }
 void scfWriteString(SCFWriter* writer, StringView string) {
    u32 len = (u32)strlen(string) + 1;
    u32 offset = writer->binarySegment.size;
 
-   writer->binarySegment.push((byte*)string, len); //push to binary segment
+   writer->binarySegment.push((byte const*)string, len); //push to binary segment
 
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
-   tlist.push(SCFType_STRING);
-   dSet.push((byte*)&offset, sizeof(offset)); // push binary offset into dataset
+   _pushType(writer, SCFType_STRING);
+   writer->arena.push((byte*)&offset, sizeof(offset)); // push binary offset into dataset
 }
 void scfWriteBytes(SCFWriter* writer, void const* data, u32 size) {
+   // the bytes themselves land 8-byte aligned (the binary segment starts aligned) so they can be used in place
    u32 offset = writer->binarySegment.size;
+   u32 padding = (8 - ((offset + sizeof(size)) & 7)) & 7;
+   writer->binarySegment.pushZeros(padding);
+   offset += padding;
 
+   writer->binarySegment.grow(sizeof(size) + size); // one growth for the whole thing
    writer->binarySegment.push((byte*)&size, sizeof(size)); //push size value to binary
-   writer->binarySegment.push((byte*)data, size); //push to binary segment
+   writer->binarySegment.push((byte const*)data, size); //push to binary segment
 
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
-   tlist.push(SCFType_BYTES);
-   dSet.push((byte*)&offset, sizeof(offset)); // push binary offset into dataset
+   _pushType(writer, SCFType_BYTES);
+   writer->arena.push((byte*)&offset, sizeof(offset)); // push binary offset into dataset
 }
 
 void* scfWriteToBuffer(SCFWriter* writer, u32* sizeOut) {
+   // anything still open gets closed, the root is whatever's left
+   while (writer->lists.size() > 1) {
+      scfWriteListEnd(writer);
+   }
+   _closeList(writer);
 
-   //first copy current list to main set
-   auto &tlist = writer->currentTypeList.back();
-   auto &dSet = writer->currentDataSet.back();
-   int padding = _roundUp(tlist.size + 1) - (tlist.size);
-
-   u32 listSize = tlist.size + padding + dSet.size;
-
-   writer->dataSegment.grow( listSize); // small optimization for a large growth
-   writer->dataSegment.push((byte*)tlist.data, tlist.size); //push typelist
-   writer->dataSegment.push((byte*)"\0\0\0\0", padding); //push padding
-   writer->dataSegment.push((byte*)dSet.data, dSet.size); //push dataset
-
-   auto dataSize = writer->dataSegment.size;
-   auto binarySize = writer->binarySegment.size;
-
-   u32 totalSize = sizeof(SCFHeader) + dataSize + binarySize;
-
-   byte* out = new byte[totalSize];
-   memset(out, 0, totalSize);
+   auto &arena = writer->arena;
 
    SCFHeader header;
-   header.binarySegmentOffset = sizeof(SCFHeader) + dataSize;
-
-   memcpy(out, (byte*)&header, sizeof(header));
-   memcpy(out + sizeof(header), writer->dataSegment.data, dataSize);
-   memcpy(out + header.binarySegmentOffset, writer->binarySegment.data, binarySize);
+   header.binarySegmentOffset = (arena.size + 7) & ~7;
+
+   // the binary segment is the only thing that gets copied, it has to come after all the lists
+   u32 totalSize = header.binarySegmentOffset + writer->binarySegment.size;
+   arena.grow(totalSize - arena.size);
+   arena.pushZeros(header.binarySegmentOffset - arena.size);
+   arena.push(writer->binarySegment.data, writer->binarySegment.size);
+   memcpy(arena.data, (byte*)&header, sizeof(header));
+
+   // the writer hands its arena over and starts fresh
+   auto out = arena.data;
+   arena = {};
+   delete[] writer->binarySegment.data;
+   writer->binarySegment = {};
+
+   arena.push((byte*)&header, sizeof(header));
+   _openList(writer);
 
    *sizeOut = totalSize;
    return out;
@@ -20,9 +20,14 @@ struct SCFReader {
    SCFHeader* header = nullptr;
    SCFType* typeList = nullptr;
    void* pos = nullptr;
+   void const* end = nullptr; // from scfViewBuffer, reads that would go past it come back null
 };
 
 SCFReader scfView(void const* scf);
+
+// checks the header against the buffer size first, use this on anything that came off disk
+// (like a MappedFile) so truncated or garbage files come back null instead of reading past the end
+SCFReader scfViewBuffer(void const* data, u64 size);
 bool scfReaderNull(SCFReader const& view);
 bool scfReaderAtEnd(SCFReader const& view);
 
@@ -46,8 +51,9 @@ void scfWriteListEnd(SCFWriter* writer);
 void scfWriteInt(SCFWriter* writer, i32 i);
 void scfWriteFloat(SCFWriter* writer, f32 f);
 void scfWriteString(SCFWriter* writer, StringView string);
-void scfWriteBytes(SCFWriter* writer, void const* data, u32 size);
+void scfWriteBytes(SCFWriter* writer, void const* data, u32 size); // scfReadBytes hands them back 8-byte aligned
 
+// closes any lists still open and hands over the writer's buffer (delete[] it), the writer starts over empty
 void* scfWriteToBuffer(SCFWriter* writer, u32* sizeOut);
 
 void DEBUG_imShowWriterStats(SCFWriter *writer);
\ No newline at end of file
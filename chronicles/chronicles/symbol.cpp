@@ -3,6 +3,10 @@
 #include <unordered_set>
 #include <cstring>
 
+#ifndef _MSC_VER
+#define _strdup strdup
+#endif
+
 struct StringViewEqual {
    bool operator()(const StringView &lhs, const StringView &rhs) const {
       return strcmp(lhs, rhs) == 0;
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "defs.h"
+#include "math.h"
+
+// Textures
+// the app implements these on GL (app.cpp), headless builds of the core get plain cpu textures (texturecpu.cpp)
+
+enum {
+   RepeatType_REPEAT,
+   RepeatType_CLAMP
+};
+typedef byte RepeatType;
+
+enum {
+   FilterType_LINEAR,
+   FilterType_NEAREST
+};
+typedef byte FilterType;
+
+typedef struct {
+   RepeatType repeatType = RepeatType_CLAMP;
+   FilterType filterType = FilterType_NEAREST;
+} TextureConfig;
+
+typedef struct Texture Texture;
+
+enum {
+   TextureFromBufferFlag_REFERENCE = 0, // do nothing with the input buffer, assume its life outlasts the texture
+   TextureFromBufferFlag_TAKE_OWNERHSIP,// Call free on the buffer on texture destroy
+   TextureFromBufferFlag_COPY           // memcpy out
+};
+typedef byte TextureFromBufferFlag;
+
+Texture *textureCreateFromPath(StringView path, TextureConfig const& config);
+Texture *textureCreateFromBuffer(byte* buffer, u64 size, TextureConfig const& config, TextureFromBufferFlag flag = 0);
+Texture *textureCreateCustom(u32 width, u32 height, TextureConfig const& config);
+void textureDestroy(Texture *self);
+
+void textureSetPixels(Texture *self, byte *data);
+// data is still a full-size buffer, only the given regions get copied and re-uploaded
+void textureSetPixelsRegions(Texture *self, byte *data, Recti const *regions, u32 count);
+Int2 textureGetSize(Texture *t);
+
+//because why not
+uPtr textureGetHandle(Texture *self);
+
+const ColorRGBA *textureGetPixels(Texture *self);
@@ -0,0 +1,82 @@
+#include "texture.h"
+
+#include <stb/stb_image.h>
+
+#include <string.h>
+
+// Textures for headless builds (tools, servers, the bench), same api as app.cpp but the pixels
+// only ever live in memory, there's nothing to upload to so there's no handle either
+
+struct Texture {
+   ColorRGBA *pixels = nullptr;
+   Int2 size = { 0 };
+   TextureConfig config;
+};
+
+static Texture *_textureFromStbi(byte *data, int x, int y, TextureConfig const& config) {
+   if (!data) {
+      return nullptr;
+   }
+
+   auto out = new Texture();
+   out->config = config;
+   out->size = { x, y };
+   out->pixels = new ColorRGBA[(u64)x * y];
+   memcpy(out->pixels, data, (u64)x * y * sizeof(ColorRGBA));
+
+   stbi_image_free(data);
+   return out;
+}
+
+Texture *textureCreateFromPath(StringView path, TextureConfig const& config) {
+   int x = 0, y = 0, comps = 0;
+   auto data = stbi_load(path, &x, &y, &comps, 4);
+   return _textureFromStbi(data, x, y, config);
+}
+Texture *textureCreateFromBuffer(byte* buffer, u64 size, TextureConfig const& config, TextureFromBufferFlag flag) {
+   int x = 0, y = 0, comps = 0;
+   auto data = stbi_load_from_memory(buffer, (int32_t)size, &x, &y, &comps, 4);
+
+   // decoded straight away so there's no reason to hang on to the source
+   if (flag == TextureFromBufferFlag_TAKE_OWNERHSIP) {
+      delete[] buffer;
+   }
+
+   return _textureFromStbi(data, x, y, config);
+}
+Texture *textureCreateCustom(u32 width, u32 height, TextureConfig const& config) {
+   auto out = new Texture();
+   out->config = config;
+   out->size = { (i32)width, (i32)height };
+   out->pixels = new ColorRGBA[(u64)width * height];
+   return out;
+}
+void textureDestroy(Texture *self) {
+   delete[] self->pixels;
+   delete self;
+}
+
+void textureSetPixels(Texture *self, byte *data) {
+   memcpy(self->pixels, data, (u64)self->size.x * self->size.y * sizeof(ColorRGBA));
+}
+void textureSetPixelsRegions(Texture *self, byte *data, Recti const *regions, u32 count) {
+   auto src = (ColorRGBA*)data;
+   for (u32 i = 0; i < count; ++i) {
+      auto &r = regions[i];
+      for (i32 y = r.y; y < r.y + r.h; ++y) {
+         auto offset = (u64)y * self->size.x + r.x;
+         memcpy(self->pixels + offset, src + offset, r.w * sizeof(ColorRGBA));
+      }
+   }
+}
+Int2 textureGetSize(Texture *t) {
+   return t->size;
+}
+
+uPtr textureGetHandle(Texture *) {
+   return 0;
+}
+
+const ColorRGBA *textureGetPixels(Texture *self) {
+   return self->pixels;
+}
@@ -13,6 +13,7 @@
 #include <SDL2/SDL_mouse.h>
 
 #define MAX_IMG_DIM 0x100000
+#define HISTORY_MEMORY_BUDGET (256ull * 1024 * 1024) // oldest undo steps get dropped past this
 
 #define POPUPID_COLORPICKER "egapicker"
 
@@ -68,8 +69,8 @@ struct BIMPState {
 
    std::string winName;
 
-   std::vector<EGATexture*> history;
-   size_t historyPosition = 0;
+   EGAHistory *history = nullptr; // revisions share unchanged tiles
+   u64 historyBudget = HISTORY_MEMORY_BUDGET;
 };
 
 static void _stateTexCleanup(BIMPState &state) {
@@ -100,11 +101,10 @@ static void _stateTexCleanup(BIMPState &state) {
 }
 
 static void _cleanupHistory(BIMPState &state) {
-   for (auto hist : state.history) {
-      egaTextureDestroy(hist);
+   if (state.history) {
+      egaHistoryDestroy(state.history);
+      state.history = nullptr;
    }
-   state.history.clear();
-   state.historyPosition = 0;
 }
 
 static void _stateDestroy(BIMPState &state) {
@@ -143,50 +143,36 @@ static void _resizeTextures(BIMPState &state, Int2 newSize) {
 }
 
 static void _saveSnapshot(BIMPState &state) {
+   if (!state.history) {
+      state.history = egaHistoryCreate(state.historyBudget);
+   }
 
-   if (state.historyPosition + 1 < state.history.size()) {
-      for (auto iter = state.history.begin() + state.historyPosition + 1; iter != state.history.end(); ++iter) {
-         egaTextureDestroy(*iter);
-      }
-      state.history.erase(state.history.begin() + state.historyPosition + 1, state.history.end());
+   egaHistoryCommit(state.history, state.ega);
+}
+
+// the history restores ega (and its size), everything else follows it
+static void _afterRevisionRestore(BIMPState &state, Int2 oldSize) {
+   auto curSize = egaTextureGetSize(state.ega);
+   if (curSize.x != oldSize.x || curSize.y != oldSize.y) {
+      _resizeTextures(state, curSize);
    }
 
-   state.history.push_back(egaTextureCreateCopy(state.ega));
-   state.historyPosition = state.history.size() - 1;
+   egaClearAlpha(state.editEGA);
 }
 static void _undo(BIMPState &state) {
-   if (state.historyPosition > 0) {
+   auto oldSize = egaTextureGetSize(state.ega);
+   if (state.history && egaHistoryGetPosition(state.history) > 0) {
       _exitRegionPicked(state);
-      --state.historyPosition;
-
-      auto revision = state.history[state.historyPosition];
-      auto revSize = egaTextureGetSize(revision);
-      auto curSize = egaTextureGetSize(state.ega);
-      if (revSize.x != curSize.x || revSize.y != curSize.y) {
-         _resizeTextures(state, revSize);
-      }
-
-      egaClearAlpha(state.ega);
-      egaClearAlpha(state.editEGA);
-      egaRenderTexture(state.ega, { 0,0 }, revision);
-      
+      egaHistoryUndo(state.history, state.ega);
+      _afterRevisionRestore(state, oldSize);
    }
 }
 static void _redo(BIMPState &state) {
-   if (state.historyPosition < state.history.size() - 1) {
+   auto oldSize = egaTextureGetSize(state.ega);
+   if (state.history && egaHistoryGetPosition(state.history) + 1 < egaHistoryGetCount(state.history)) {
       _exitRegionPicked(state);
-      ++state.historyPosition;
-
-      auto revision = state.history[state.historyPosition];
-      auto revSize = egaTextureGetSize(revision);
-      auto curSize = egaTextureGetSize(state.ega);
-      if (revSize.x != curSize.x || revSize.y != curSize.y) {
-         _resizeTextures(state, revSize);
-      }
-
-      egaClearAlpha(state.ega);
-      egaClearAlpha(state.editEGA);
-      egaRenderTexture(state.ega, { 0,0 }, revision);
+      egaHistoryRedo(state.history, state.ega);
+      _afterRevisionRestore(state, oldSize);
    }
 }
 
@@ -350,11 +336,8 @@ static void _doToolbar(Window* wnd, BIMPState &state) {
    auto &imStyle = ImGui::GetStyle();
 
    //if (ImGui::Begin("historydebug", 0, ImGuiWindowFlags_AlwaysAutoResize)) {
-   //   ImGui::Text("History Position: %d", state.historyPosition);
-   //   int i = 0;
-   //   for (auto h : state.history) {
-   //      ImGui::Text("Snapshot %d", i++);
-   //   }
+   //   ImGui::Text("History Position: %d / %d", egaHistoryGetPosition(state.history), egaHistoryGetCount(state.history));
+   //   ImGui::Text("History Memory: %llu KB", egaHistoryGetMemorySize(state.history) / 1024);
    //}
    //ImGui::End();
 
@@ -394,7 +377,7 @@ static void _doToolbar(Window* wnd, BIMPState &state) {
       if (state.toolState == ToolStates_PENCIL) { ImGui::PopStyleColor(); }
       if (state.toolState == ToolStates_FLOODFILL) { ImGui::PushStyleColor(ImGuiCol_Button, ImGui::GetStyleColorVec4(ImGuiCol_ButtonActive)); }
       bool btnFill = ImGui::Button(ICON_FA_PAINT_BRUSH " Flood Fill");
-      if (ImGui::IsItemHovered()) { ImGui::SetTooltip("(F) Shift for color replace"); }
+      if (ImGui::IsItemHovered()) { ImGui::SetTooltip("(F) Shift for color replace, Ctrl for diagonals"); }
       if (state.toolState == ToolStates_FLOODFILL) { ImGui::PopStyleColor(); }
       if (state.erase) { ImGui::PushStyleColor(ImGuiCol_Button, ImGui::GetStyleColorVec4(ImGuiCol_ButtonActive)); }
       bool btnErase = ImGui::Button(ICON_FA_ERASER " Eraser");
@@ -644,65 +627,6 @@ static Recti _makeRect(Int2 const &a, Int2 const &b) {
    return { MIN(a.x, b.x), MIN(a.y, b.y), labs(b.x - a.x) + 1,  labs(b.y - a.y) + 1 };
 }
 
-static void _floodFill(EGATexture *tex, Int2 mousePoint, EGAPColor c) {
-   auto texSize = egaTextureGetSize(tex);
-   auto pixelCount = texSize.x * texSize.y;
-   byte *visited = new byte[pixelCount];
-   memset(visited, 0, pixelCount);
-
-   auto oc = egaTextureGetColorAt(tex, mousePoint.x, mousePoint.y);
-   std::vector<Int2> neighbors;
-   neighbors.push_back(mousePoint);
-
-   while (!neighbors.empty()) {
-      auto spot = neighbors.back();
-      neighbors.pop_back();
-      auto idx = spot.y * texSize.x + spot.x;
-
-      visited[idx] = true;
-
-      if (egaTextureGetColorAt(tex, spot.x, spot.y) == oc) {
-         egaRenderPoint(tex, spot, c);
-
-         Int2 n = { spot.x, spot.y - 1 };
-         if (n.x >= 0 && n.x < texSize.x && n.y >= 0 && n.y < texSize.y) {
-            auto idx = n.y * texSize.x + n.x;
-            if (!visited[idx]) {
-               neighbors.push_back(n);
-            }
-         }
-
-         n = { spot.x, spot.y + 1 };
-         if (n.x >= 0 && n.x < texSize.x && n.y >= 0 && n.y < texSize.y) {
-            auto idx = n.y * texSize.x + n.x;
-            if (!visited[idx]) {
-               neighbors.push_back(n);
-            }
-         }
-
-         n = { spot.x+1, spot.y };
-         if (n.x >= 0 && n.x < texSize.x && n.y >= 0 && n.y < texSize.y) {
-            auto idx = n.y * texSize.x + n.x;
-            if (!visited[idx]) {
-               neighbors.push_back(n);
-            }
-         }
-
-         n = { spot.x-1, spot.y };
-         if (n.x >= 0 && n.x < texSize.x && n.y >= 0 && n.y < texSize.y) {
-            auto idx = n.y * texSize.x + n.x;
-            if (!visited[idx]) {
-               neighbors.push_back(n);
-            }
-         }
-      }
-   }
-
-   visited[texSize.x*mousePoint.y+mousePoint.y] = true;
-
-   delete[] visited;
-}
-
 static void _commitEditPlane(BIMPState &state) {
    egaRenderTexture(state.ega, { 0,0 }, state.editEGA);
    egaClearAlpha(state.editEGA);
@@ -774,7 +698,7 @@ static void _doToolMousePressed(BIMPState &state, Int2 mouse) {
          egaColorReplace(state.ega, egaTextureGetColorAt(state.ega, mouse.x, mouse.y), color);
       }
       else {
-         _floodFill(state.ega, mouse, color);
+         egaFloodFill(state.ega, mouse, color, io.KeyCtrl);
       }
       
       state.mouseDown = false;
@@ -818,6 +742,7 @@ static bool _cutSnippet(BIMPState &state, Int2 mouse) {
    egaClearAlpha(state.snippet);
 
    egaRenderTexturePartial(state.snippet, { 0,0 }, state.ega, snippetRegion);
+   egaTextureCompile(state.snippet); // gets redrawn every frame while dragging
    egaRenderRect(state.ega, snippetRegion, EGA_ALPHA);
    egaClearAlpha(state.editEGA);
    egaRenderTexture(state.editEGA, state.snippetPosition, state.snippet);
@@ -910,6 +835,7 @@ static void _handleInput(BIMPState &state, Float2 pxSize, Float2 cursorPos) {
                      (i32)state.mousePos.y - snip->dragPos.y };
 
                   state.snippet = egaTextureCreateCopy(snip->snippet);
+                  egaTextureCompile(state.snippet);
                }
 
                
@@ -0,0 +1,296 @@
+// Batch PNG -> EGA converter
+// encodes every png it's given (directories are searched recursively) on a pool of worker threads
+// and writes each one out as an SCF asset at the same relative path under the output folder
+//
+// usage: egaconvert [-o folder] [-threads n] [-shared] [-palette name] input...
+//
+// - each asset is a list of: string name, bytes palette (16 EGA colors), bytes texture
+//   (egaTextureSerialize output, egaTextureDeserialize it or view it in place if it's PACKED)
+// - by default every image solves its own palette the same way BIMP does
+// - -shared solves one palette for the whole set from all of their color counts merged together
+//   and encodes everything against it, the palette also gets stored in the output folder's pal.bin
+//   under -palette's name (default "shared") so the game can find it
+
+#include "ega.h"
+#include "scf.h"
+#include "file.h"
+#include "assets.h"
+#include "texture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+struct ConvertConfig {
+   std::string outFolder = ".";
+   u32 threads = 0;        // 0 is one per core
+   bool shared = false;
+   std::string sharedName = "shared";
+};
+
+struct ConvertJob {
+   fs::path source;
+   std::string name;       // path relative to the input it came from, no extension, forward slashes
+   bool ok = false;
+   std::string error;
+};
+
+static f64 _nowMs() {
+   using namespace std::chrono;
+   return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+static bool _isPNG(fs::path const& p) {
+   auto ext = p.extension().string();
+   std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower(c); });
+   return ext == ".png";
+}
+
+static std::string _jobName(fs::path const& relative) {
+   auto out = relative;
+   out.replace_extension();
+   return out.generic_string();
+}
+
+// files go in as-is, directories get every png under them
+static bool _gatherJobs(StringView input, std::vector<ConvertJob> &jobs) {
+   std::error_code ec;
+   fs::path root(input);
+
+   if (fs::is_directory(root, ec)) {
+      for (auto it = fs::recursive_directory_iterator(root, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+         if (it->is_regular_file(ec) && _isPNG(it->path())) {
+            jobs.push_back({ it->path(), _jobName(fs::relative(it->path(), root, ec)) });
+         }
+      }
+      return !ec;
+   }
+
+   if (fs::is_regular_file(root, ec)) {
+      jobs.push_back({ root, _jobName(root.filename()) });
+      return true;
+   }
+
+   return false;
+}
+
+// runs fn(job) over every job, each worker grabs the next one as soon as it's free
+// sprites and backdrops are wildly different sizes so handing out fixed chunks would leave cores idle
+// the encodes split big images across threads too, so the workers share the thread count with them
+// instead of each one starting a thread per core
+template<typename Fn>
+static void _runPool(std::vector<ConvertJob> &jobs, u32 threads, Fn &&fn) {
+   u32 workerCount = std::max(1u, std::min(threads, (u32)jobs.size()));
+   u32 encodeThreads = std::max(1u, threads / workerCount);
+
+   std::atomic<u32> next(0);
+   auto work = [&] {
+      egaSetEncodeThreads(encodeThreads);
+      for (u32 i = next++; i < jobs.size(); i = next++) {
+         fn(jobs[i]);
+      }
+   };
+
+   std::vector<std::thread> workers;
+   for (u32 i = 1; i < workerCount; ++i) {
+      workers.emplace_back(work);
+   }
+   work();
+
+   for (auto &t : workers) {
+      t.join();
+   }
+}
+
+static bool _writeAsset(ConvertConfig const& config, ConvertJob &job, EGATexture *ega, EGAPalette const& palette) {
+   byte *texture = nullptr;
+   u64 textureSize = 0;
+   if (!egaTextureSerialize(ega, &texture, &textureSize)) {
+      job.error = "serialize failed";
+      return false;
+   }
+
+   auto writer = scfWriterCreate();
+   scfWriteString(writer, job.name.c_str());
+   scfWriteBytes(writer, palette.colors, sizeof(palette.colors));
+   scfWriteBytes(writer, texture, (u32)textureSize);
+   delete[] texture;
+
+   u32 bSize = 0;
+   auto buffer = scfWriteToBuffer(writer, &bSize);
+   scfWriterDestroy(writer);
+
+   std::error_code ec;
+   auto path = fs::path(config.outFolder) / (job.name + ".ega");
+   fs::create_directories(path.parent_path(), ec);
+
+   bool ok = fileWrite(path.string().c_str(), buffer, bSize);
+   delete[] (byte*)buffer;
+
+   if (!ok) {
+      job.error = format("couldn't write %s", path.string().c_str());
+   }
+   return ok;
+}
+
+static void _convert(ConvertConfig const& config, ConvertJob &job, EGAPalette const& target) {
+   auto png = textureCreateFromPath(job.source.string().c_str(), { RepeatType_CLAMP, FilterType_NEAREST });
+   if (!png) {
+      job.error = "couldn't load png";
+      return;
+   }
+
+   auto targetPalette = target;
+   EGAPalette resultPalette;
+   auto ega = egaTextureCreateFromTextureEncode(png, &targetPalette, &resultPalette);
+   textureDestroy(png);
+
+   if (!ega) {
+      job.error = "encode failed";
+      return;
+   }
+
+   job.ok = _writeAsset(config, job, ega, resultPalette);
+   egaTextureDestroy(ega);
+}
+
+// every image's color counts go into one histogram and the palette gets solved from that
+// the pngs get loaded again for the encode rather than held onto, a full game's art won't fit
+static bool _solveShared(ConvertConfig const& config, std::vector<ConvertJob> &jobs, EGAPalette &shared) {
+   std::vector<u32> counts((u64)jobs.size() * EGA_COLORS);
+
+   _runPool(jobs, config.threads, [&](ConvertJob &job) {
+      auto png = textureCreateFromPath(job.source.string().c_str(), { RepeatType_CLAMP, FilterType_NEAREST });
+      if (!png) {
+         job.error = "couldn't load png";
+         return;
+      }
+
+      egaTextureEncodeHistogram(png, counts.data() + (u64)(&job - jobs.data()) * EGA_COLORS);
+      textureDestroy(png);
+   });
+
+   // a whole game's worth of backdrops can pass 2^32 pixels, merge wide and scale down to fit
+   u64 wide[EGA_COLORS] = { 0 };
+   u64 largest = 0;
+   for (u64 i = 0; i < jobs.size(); ++i) {
+      for (u32 c = 0; c < EGA_COLORS; ++c) {
+         wide[c] += counts[i * EGA_COLORS + c];
+      }
+   }
+   for (u32 c = 0; c < EGA_COLORS; ++c) {
+      largest = std::max(largest, wide[c]);
+   }
+
+   u32 shift = 0;
+   while ((largest >> shift) > 0xFFFFFFFFull) {
+      ++shift;
+   }
+
+   // colors that show up at all stay in the running even if scaling would round them away
+   u32 merged[EGA_COLORS] = { 0 };
+   for (u32 c = 0; c < EGA_COLORS; ++c) {
+      merged[c] = wide[c] ? (u32)std::max(1ull, (unsigned long long)(wide[c] >> shift)) : 0;
+   }
+
+   EGAPalette target;
+   memset(target.colors, EGA_COLOR_UNDEFINED, sizeof(target.colors));
+   return egaPaletteReduce(merged, &target, &shared);
+}
+
+int main(int argc, char** argv) {
+   ConvertConfig config;
+   std::vector<StringView> inputs;
+
+   for (int i = 1; i < argc; ++i) {
+      if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+         config.outFolder = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-threads") && i + 1 < argc) {
+         config.threads = (u32)atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-shared")) {
+         config.shared = true;
+      }
+      else if (!strcmp(argv[i], "-palette") && i + 1 < argc) {
+         config.sharedName = argv[++i];
+      }
+      else if (argv[i][0] != '-') {
+         inputs.push_back(argv[i]);
+      }
+      else {
+         inputs.clear();
+         break;
+      }
+   }
+
+   if (inputs.empty()) {
+      fprintf(stderr, "usage: %s [-o folder] [-threads n] [-shared] [-palette name] input...\n", argv[0]);
+      return 1;
+   }
+
+   if (!config.threads) {
+      config.threads = std::max(1u, std::thread::hardware_concurrency());
+   }
+
+   std::vector<ConvertJob> jobs;
+   for (auto input : inputs) {
+      if (!_gatherJobs(input, jobs)) {
+         fprintf(stderr, "couldn't read %s\n", input);
+         return 1;
+      }
+   }
+
+   // the same name twice would have two workers writing the same file, first one wins
+   std::sort(jobs.begin(), jobs.end(), [](ConvertJob const& a, ConvertJob const& b) { return a.name < b.name; });
+   jobs.erase(std::unique(jobs.begin(), jobs.end(), [](ConvertJob const& a, ConvertJob const& b) { return a.name == b.name; }), jobs.end());
+
+   std::error_code ec;
+   fs::create_directories(config.outFolder, ec);
+
+   egaStartup();
+
+   auto start = _nowMs();
+
+   EGAPalette target;
+   memset(target.colors, EGA_COLOR_UNDEFINED, sizeof(target.colors));
+
+   if (config.shared) {
+      if (!_solveShared(config, jobs, target)) {
+         fprintf(stderr, "couldn't solve a shared palette\n");
+         return 1;
+      }
+
+      auto assets = assetsCreate(config.outFolder.c_str());
+      assetsPaletteStore(assets, config.sharedName.c_str(), &target);
+      assetsDestroy(assets);
+   }
+
+   _runPool(jobs, config.threads, [&](ConvertJob &job) {
+      if (job.error.empty()) {
+         _convert(config, job, target);
+      }
+   });
+
+   u32 failed = 0;
+   for (auto &job : jobs) {
+      if (!job.ok) {
+         fprintf(stderr, "%s: %s\n", job.source.string().c_str(), job.error.c_str());
+         ++failed;
+      }
+   }
+
+   printf("converted %u of %u images in %.1f ms on %u threads\n",
+      (u32)jobs.size() - failed, (u32)jobs.size(), _nowMs() - start, config.threads);
+
+   return failed ? 1 : 0;
+}